@@ -0,0 +1,166 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * bus bandwidth model and admission control
+ *
+ * At 9600 baud 8n1 the link carries 960 bytes per second and it is
+ * shared with the rest of the J1708 bus. Every buffer of packets is
+ * checked against a one second budget before it is queued for the port.
+ * The budget is the link minus the headroom. Low priority updates only
+ * get part of it, so regular updates still find room, and only urgent
+ * frames like triggers and resets may use the headroom as well.
+ *
+ * The window slides in steps of BUDGET_SLOT_MS. A slot is only
+ * forgotten once a whole window has passed after its end, so no second
+ * of bus time, wherever it starts, carries more than the budget.
+ *
+ * All times are in milliseconds from any monotonic source.
+ */
+
+#include "common.h"
+#include "budget.h"
+
+void budget_init(struct bus_budget_t *budget, uint32_t baud,
+	uint8_t headroom, uint64_t now) {
+
+	if (headroom > 100) headroom = 100;
+
+	memset(budget, 0, sizeof(struct bus_budget_t));
+	budget->capacity = baud / BITS_PER_BYTE;
+	budget->limit = budget->capacity * (100 - headroom) / 100;
+	budget->start = now;
+}
+
+/*
+ * time in microseconds that len bytes occupy the wire
+ *
+ */
+uint32_t budget_wire_time(struct bus_budget_t *budget, uint16_t len) {
+	return (uint64_t)len * 1000000 / budget->capacity;
+}
+
+/* forget the slots that have slid out of the window */
+static void slide_window(struct bus_budget_t *budget, uint64_t now) {
+	uint64_t slot = (now - budget->start) / BUDGET_SLOT_MS;
+	uint32_t *bytes;
+
+	/* all of them */
+	if (slot - budget->slot > BUDGET_SLOTS) {
+		memset(budget->slot_bytes, 0, sizeof(budget->slot_bytes));
+		budget->window_bytes = 0;
+		budget->slot = slot;
+		return;
+	}
+
+	while (budget->slot < slot) {
+		budget->slot++;
+		bytes = &budget->slot_bytes[budget->slot % (BUDGET_SLOTS + 1)];
+		budget->window_bytes -= *bytes;
+		*bytes = 0;
+	}
+}
+
+/*
+ * decide whether len bytes may be queued now
+ *
+ */
+int8_t budget_admit(struct bus_budget_t *budget, uint16_t len,
+	uint8_t prio, uint64_t now) {
+	uint32_t limit;
+
+	switch (prio) {
+		case PRIO_URGENT:
+			limit = budget->capacity;
+			break;
+		case PRIO_HIGH:
+			limit = budget->limit;
+			break;
+		default:
+			limit = budget->limit * BUDGET_LOW_SHARE / 100;
+			break;
+	}
+
+	slide_window(budget, now);
+
+	if (budget->window_bytes + len <= limit) {
+		budget->slot_bytes[budget->slot % (BUDGET_SLOTS + 1)] += len;
+		budget->window_bytes += len;
+		if (budget->window_bytes > budget->peak_bytes)
+			budget->peak_bytes = budget->window_bytes;
+		budget->total_bytes += len;
+		budget->admitted++;
+		return BUDGET_ADMIT;
+	}
+
+	/* too big for even an empty window */
+	if (len > limit) {
+		budget->rejected++;
+		return BUDGET_REJECT;
+	}
+
+	budget->deferred++;
+	return BUDGET_DEFER;
+}
+
+/*
+ * milliseconds until the oldest bytes slide out of the window
+ *
+ */
+uint32_t budget_wait(struct bus_budget_t *budget, uint64_t now) {
+	uint64_t slot;
+	uint64_t free_at;
+
+	slide_window(budget, now);
+
+	for (int8_t i = BUDGET_SLOTS; i >= 0; i--) {
+		if (budget->slot < (uint8_t)i) continue;
+
+		slot = budget->slot - i;
+		if (!budget->slot_bytes[slot % (BUDGET_SLOTS + 1)]) continue;
+
+		free_at = budget->start + (slot + BUDGET_SLOTS + 1) *
+			BUDGET_SLOT_MS;
+		return free_at > now ? free_at - now : 0;
+	}
+
+	return 0;
+}
+
+/*
+ * average bus load since budget_init() in tenths of a percent
+ *
+ */
+uint16_t budget_load(struct bus_budget_t *budget, uint64_t now) {
+	uint64_t elapsed = now - budget->start;
+
+	/* anything sent within the first window counts for a full one */
+	if (elapsed < BUDGET_WINDOW_MS) elapsed = BUDGET_WINDOW_MS;
+
+	return budget->total_bytes * 1000 * 1000 /
+		(elapsed * budget->capacity);
+}
+
+/*
+ * load of the busiest window in tenths of a percent
+ *
+ */
+uint16_t budget_peak_load(struct bus_budget_t *budget) {
+	return (uint64_t)budget->peak_bytes * 1000 / budget->capacity;
+}
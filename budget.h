@@ -0,0 +1,71 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define BUS_BAUD		9600
+#define BITS_PER_BYTE		10	/* 8n1: start + 8 data + stop bits */
+#define BUDGET_WINDOW_MS	1000
+#define BUDGET_SLOTS		10	/* the window slides in these steps */
+#define BUDGET_SLOT_MS		(BUDGET_WINDOW_MS / BUDGET_SLOTS)
+
+/* share of the bus left to other J1708 nodes by default (percent) */
+#define DEFAULT_HEADROOM	25
+
+/* share of the budget low priority updates may fill (percent) */
+#define BUDGET_LOW_SHARE	75
+
+/* update priorities */
+#define PRIO_LOW		0	/* may be deferred or dropped */
+#define PRIO_HIGH		1	/* regular sign updates */
+#define PRIO_URGENT		2	/* may use the headroom as well */
+
+/* admission results */
+#define BUDGET_REJECT		-1	/* will never fit, drop it */
+#define BUDGET_DEFER		0	/* try again in the next window */
+#define BUDGET_ADMIT		1
+
+/* bus bandwidth budget */
+typedef struct bus_budget_t {
+	uint32_t capacity;	/* bytes per second the link can carry */
+	uint32_t limit;		/* bytes per second left after headroom */
+
+	/*
+	 * bytes per slot of the sliding window, the slot being filled
+	 * is kept along with the ones of the last full window
+	 */
+	uint32_t slot_bytes[BUDGET_SLOTS + 1];
+	uint64_t slot;		/* current slot since start */
+	uint32_t window_bytes;	/* in all slots */
+
+	/* statistics */
+	uint64_t start;		/* ms */
+	uint64_t total_bytes;
+	uint32_t peak_bytes;	/* busiest window */
+	uint32_t admitted;
+	uint32_t deferred;
+	uint32_t rejected;
+} bus_budget_t;
+
+extern void budget_init(struct bus_budget_t *budget, uint32_t baud,
+	uint8_t headroom, uint64_t now);
+extern uint32_t budget_wire_time(struct bus_budget_t *budget, uint16_t len);
+extern int8_t budget_admit(struct bus_budget_t *budget, uint16_t len,
+	uint8_t prio, uint64_t now);
+extern uint32_t budget_wait(struct bus_budget_t *budget, uint64_t now);
+extern uint16_t budget_load(struct bus_budget_t *budget, uint64_t now);
+extern uint16_t budget_peak_load(struct bus_budget_t *budget);
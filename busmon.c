@@ -0,0 +1,250 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * passive J1708/J1587 bus monitor
+ *
+ * J1708 has no framing bytes, a frame ends when the bus goes idle for
+ * at least 10 bit times and carries a checksum that makes all of its
+ * bytes add up to zero. The reader only gets a time stamp for every
+ * chunk returned by read(), so the bytes of a chunk are assumed to have
+ * arrived back to back, ending at that time stamp.
+ *
+ * All times are in microseconds from a monotonic source. The work done
+ * per byte is constant so this keeps up with the line easily.
+ */
+
+#include "common.h"
+#include "budget.h"
+#include "busmon.h"
+
+void busmon_init(struct bus_monitor_t *mon, uint32_t baud,
+	uint64_t now, busmon_cb_t cb, void *cb_arg) {
+	memset(mon, 0, sizeof(struct bus_monitor_t));
+	mon->byte_us = BITS_PER_BYTE * 1000000 / baud;
+	mon->gap_us = BUSMON_GAP_BITS * 1000000 / baud;
+	mon->start = now;
+	mon->cb = cb;
+	mon->cb_arg = cb_arg;
+}
+
+/* bytes taken by the data of a parameter starting at frame[i] */
+static uint16_t param_len(uint8_t *frame, uint8_t len, uint8_t i) {
+	uint8_t pid = frame[i];
+
+	if (pid < 128) return 2;
+	if (pid < 192) return 3;
+	/* variable length, a byte count comes first */
+	if (pid < 254) return i + 1 < len ? 2 + frame[i + 1] : len - i;
+	/*
+	 * data link escape, proprietary but signs and most others put
+	 * the MID it is for and a byte count first
+	 */
+	if (i + 2 < len && i + 3 + frame[i + 2] < len) return 3 + frame[i + 2];
+	return len - i > 1 ? len - i - 1 : 1;
+}
+
+/*
+ * length of the J1587 message at the start of a frame
+ *
+ * A checksum can only follow a complete parameter. If the whole frame
+ * is one message that wins, otherwise the first message that fits is
+ * split off. A frame that adds up but does not parse is taken whole
+ * (0 if nothing fits).
+ */
+static uint8_t message_len(uint8_t *frame, uint8_t len) {
+	uint8_t first = 0;
+	uint8_t sum = frame[0];
+	uint16_t i = 1;
+	uint16_t n;
+
+	while (i < len) {
+		if (!(uint8_t)(sum + frame[i])) {
+			if (i == len - 1) return len;
+			if (!first) first = i + 1;
+		}
+
+		/* extension: the next PID is on page 2 */
+		while (frame[i] == 255 && i < len - 1) sum += frame[i++];
+
+		n = param_len(frame, len, i);
+		for (; n && i < len; n--) sum += frame[i++];
+	}
+
+	if (first) return first;
+
+	for (i = 1; i < len; i++) sum += frame[i];
+
+	return sum ? 0 : len;
+}
+
+/* count the parameters of a J1587 message */
+static void count_pids(struct bus_monitor_t *mon, uint8_t *frame,
+	uint8_t len) {
+	uint16_t page = 0;
+	uint16_t i = 1;
+
+	/* skip the MID, stop before the checksum */
+	while (i < len - 1) {
+		if (frame[i] == 255) {
+			page = 256;
+			i++;
+			continue;
+		}
+
+		mon->pid_count[page + frame[i]]++;
+		page = 0;
+
+		if (frame[i] == 254) break;
+		i += param_len(frame, len - 1, i);
+	}
+}
+
+static uint8_t gap_bucket(uint64_t gap_us) {
+	uint8_t bucket = 0;
+	uint64_t ms = gap_us / 1000;
+
+	while (ms && bucket < BUSMON_GAP_BUCKETS - 1) {
+		ms >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+/* hand over the first len bytes of the frame being assembled */
+static void emit_frame(struct bus_monitor_t *mon, uint8_t len,
+	uint8_t valid) {
+	uint64_t gap = 0;
+
+	if (mon->last_frame && mon->frame_start > mon->last_frame)
+		gap = mon->frame_start - mon->last_frame;
+
+	mon->frames++;
+	if (valid) {
+		mon->mid_frames[mon->frame[0]]++;
+		count_pids(mon, mon->frame, len);
+	} else {
+		mon->bad_frames++;
+	}
+	if (mon->last_frame) mon->gap_hist[gap_bucket(gap)]++;
+
+	if (mon->cb) mon->cb(mon->cb_arg, mon->frame, len, valid, gap);
+
+	/* keep whatever followed the frame */
+	mon->frame_len -= len;
+	memmove(mon->frame, mon->frame + len, mon->frame_len);
+	mon->sum = 0;
+	for (uint8_t i = 0; i < mon->frame_len; i++) mon->sum += mon->frame[i];
+
+	mon->last_frame = mon->frame_start + len * mon->byte_us;
+	mon->frame_start = mon->last_frame;
+}
+
+/* hand over every message in the frame being assembled */
+static void close_frame(struct bus_monitor_t *mon) {
+	uint8_t len;
+
+	while (mon->frame_len) {
+		len = message_len(mon->frame, mon->frame_len);
+		if (!len) {
+			emit_frame(mon, mon->frame_len, 0);
+			break;
+		}
+		emit_frame(mon, len, 1);
+	}
+}
+
+/*
+ * a frame ran past the J1708 limit without an idle gap, which happens
+ * when read() returns several frames at once: split off the first
+ * message
+ */
+static void split_frame(struct bus_monitor_t *mon) {
+	uint8_t len = message_len(mon->frame, mon->frame_len);
+
+	if (len) {
+		emit_frame(mon, len, 1);
+	} else if (mon->frame_len == BUSMON_MAX_FRAME) {
+		/* garbage, give up on it */
+		emit_frame(mon, mon->frame_len, 0);
+	}
+}
+
+void busmon_feed(struct bus_monitor_t *mon, uint8_t *data,
+	uint16_t len, uint64_t now) {
+	uint64_t t;
+	uint64_t idle;
+
+	if (!len) return;
+
+	/* end of the first byte in this chunk */
+	t = now - (uint64_t)(len - 1) * mon->byte_us;
+
+	for (uint16_t i = 0; i < len; i++, t += mon->byte_us) {
+		if (mon->frame_len) {
+			idle = t > mon->last_byte + mon->byte_us ?
+				t - mon->last_byte - mon->byte_us : 0;
+
+			if ((idle >= mon->gap_us && !mon->sum) ||
+				idle >= BUSMON_TIMEOUT_US)
+				close_frame(mon);
+		}
+
+		if (!mon->frame_len) mon->frame_start = t - mon->byte_us;
+
+		mon->frame[mon->frame_len++] = data[i];
+		mon->sum += data[i];
+		mon->last_byte = t;
+		mon->bytes++;
+
+		if (mon->frame_len > J1708_MAX_FRAME) split_frame(mon);
+	}
+}
+
+/*
+ * time after which the frame being assembled is complete for sure
+ * (0 if there is none)
+ *
+ */
+uint64_t busmon_deadline(struct bus_monitor_t *mon) {
+	if (!mon->frame_len) return 0;
+
+	return mon->last_byte + (mon->sum ? BUSMON_TIMEOUT_US : mon->gap_us);
+}
+
+/*
+ * close the frame being assembled once the bus has gone idle
+ *
+ */
+void busmon_flush(struct bus_monitor_t *mon, uint64_t now) {
+	if (mon->frame_len && now >= busmon_deadline(mon)) close_frame(mon);
+}
+
+/*
+ * bus utilization since busmon_init() in tenths of a percent
+ *
+ */
+uint16_t busmon_load(struct bus_monitor_t *mon, uint64_t now) {
+	uint64_t elapsed = now - mon->start;
+
+	if (!elapsed) return 0;
+
+	return mon->bytes * mon->byte_us * 1000 / elapsed;
+}
@@ -0,0 +1,72 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define BUSMON_MAX_FRAME	64
+#define J1708_MAX_FRAME		21	/* longest frame while driving */
+
+/*
+ * frames end after 10 bit times of idle bus, a frame that is not
+ * complete yet is only cut short after a much longer silence
+ */
+#define BUSMON_GAP_BITS		10
+#define BUSMON_TIMEOUT_US	20000
+
+/* inter-frame gap histogram: < 1 ms, < 2 ms, ... < 1024 ms, longer */
+#define BUSMON_GAP_BUCKETS	12
+
+/* J1587 PIDs 0-255 (page 1) and 256-511 (page 2) */
+#define J1587_NUM_PIDS		512
+
+typedef void (*busmon_cb_t)(void *arg, uint8_t *frame, uint8_t len,
+	uint8_t valid, uint64_t gap_us);
+
+/* passive bus monitor */
+typedef struct bus_monitor_t {
+	uint32_t byte_us;	/* time on the wire for one byte */
+	uint32_t gap_us;
+
+	/* frame being assembled */
+	uint8_t frame[BUSMON_MAX_FRAME];
+	uint8_t frame_len;
+	uint8_t sum;
+	uint64_t frame_start;
+	uint64_t last_byte;	/* end of the last byte received */
+	uint64_t last_frame;	/* end of the last frame */
+
+	/* called for every frame */
+	busmon_cb_t cb;
+	void *cb_arg;
+
+	/* statistics */
+	uint64_t start;
+	uint64_t bytes;
+	uint32_t frames;
+	uint32_t bad_frames;
+	uint32_t mid_frames[256];
+	uint32_t pid_count[J1587_NUM_PIDS];
+	uint32_t gap_hist[BUSMON_GAP_BUCKETS];
+} bus_monitor_t;
+
+extern void busmon_init(struct bus_monitor_t *mon, uint32_t baud,
+	uint64_t now, busmon_cb_t cb, void *cb_arg);
+extern void busmon_feed(struct bus_monitor_t *mon, uint8_t *data,
+	uint16_t len, uint64_t now);
+extern uint64_t busmon_deadline(struct bus_monitor_t *mon);
+extern void busmon_flush(struct bus_monitor_t *mon, uint64_t now);
+extern uint16_t busmon_load(struct bus_monitor_t *mon, uint64_t now);
@@ -0,0 +1,139 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * cache of fully encoded packet sets
+ *
+ * Playlists and repeated stop names keep sending the same text to the
+ * same signs. Instead of transcoding, segmenting and checksumming it
+ * again, the finished bytes are copied from here.
+ */
+
+#include "common.h"
+#include "packet.h"
+#include "text.h"
+#include "cache.h"
+
+/* FNV-1a */
+static uint32_t hash_text(char *text, uint16_t *len) {
+	uint32_t hash = 2166136261u;
+	uint16_t i;
+
+	for (i = 0; text[i]; i++) {
+		hash ^= (uint8_t)text[i];
+		hash *= 16777619u;
+	}
+
+	*len = i;
+
+	return hash;
+}
+
+static uint8_t entry_matches(struct cache_entry_t *entry, uint32_t hash,
+	struct ctlr_cfg_t ctlr, struct sign_caps_t caps, uint8_t address,
+	struct text_pos_t pos, char *text, struct text_fmt_t *fmt,
+	uint8_t num_fmts) {
+
+	if (!entry->last_used || entry->hash != hash) return 0;
+	if (entry->address != address || entry->num_fmts != num_fmts) return 0;
+	if (entry->pos.line != pos.line || entry->pos.h != pos.h ||
+		entry->pos.v != pos.v) return 0;
+	if (entry->ctlr.mid != ctlr.mid ||
+		entry->ctlr.ext_pid != ctlr.ext_pid ||
+		entry->ctlr.pid != ctlr.pid) return 0;
+	if (entry->caps.seg_len != caps.seg_len ||
+		entry->caps.max_segs != caps.max_segs) return 0;
+
+	for (uint8_t i = 0; i < num_fmts; i++) {
+		if (entry->fmt[i].name != fmt[i].name ||
+			entry->fmt[i].value != fmt[i].value) return 0;
+	}
+
+	return strcmp(entry->text, text) == 0;
+}
+
+void cache_init(struct text_cache_t *cache) {
+	memset(cache, 0, sizeof(struct text_cache_t));
+}
+
+/*
+ * encode text followed by format packets for one sign, or copy them
+ * from the cache if they were encoded before
+ *
+ */
+int8_t make_text_cached(struct text_cache_t *cache,
+	struct ctlr_cfg_t ctlr, struct sign_caps_t caps,
+	struct data_buf_t *buf, uint8_t address, struct text_pos_t pos,
+	char *text, struct text_fmt_t *fmt, uint8_t num_fmts) {
+	struct cache_entry_t *entry;
+	struct cache_entry_t *oldest = &cache->entry[0];
+	struct data_buf_t fmt_buf;
+	uint16_t text_len;
+	uint32_t hash = hash_text(text, &text_len);
+
+	if (num_fmts > MAX_FORMAT_OPTS) return -1;
+
+	for (uint8_t i = 0; i < CACHE_ENTRIES; i++) {
+		entry = &cache->entry[i];
+
+		if (entry_matches(entry, hash, ctlr, caps, address, pos,
+			text, fmt, num_fmts)) {
+			if (entry->len > buf->size) return -1;
+			memcpy(buf->data, entry->data, entry->len);
+			buf->len = entry->len;
+			entry->last_used = ++cache->use_count;
+			cache->hits++;
+			return 1;
+		}
+
+		if (entry->last_used < oldest->last_used) oldest = entry;
+	}
+
+	cache->misses++;
+
+	/* encode it */
+	if (make_text_at(ctlr, caps, buf, address, pos, text) < 0)
+		return -1;
+
+	for (uint8_t i = 0; i < num_fmts; i++) {
+		fmt_buf.data = buf->data + buf->len;
+		fmt_buf.size = buf->size - buf->len;
+		if (make_format_packet(ctlr, &fmt_buf, fmt[i]) < 0) return -1;
+		buf->len += fmt_buf.len;
+	}
+
+	/* too long to keep */
+	if (text_len > MAX_TEXT_LEN || buf->len > CACHE_DATA_LEN) return 1;
+
+	/* replace the least recently used entry */
+	entry = oldest;
+	entry->hash = hash;
+	entry->ctlr = ctlr;
+	entry->caps = caps;
+	entry->address = address;
+	entry->pos = pos;
+	entry->num_fmts = num_fmts;
+	memcpy(entry->fmt, fmt, num_fmts * sizeof(struct text_fmt_t));
+	memcpy(entry->text, text, text_len + 1);
+	memcpy(entry->data, buf->data, buf->len);
+	entry->len = buf->len;
+	entry->last_used = ++cache->use_count;
+
+	return 1;
+}
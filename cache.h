@@ -0,0 +1,61 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CACHE_ENTRIES
+#define CACHE_ENTRIES	16
+#endif
+
+/* longest packet set: all text segments plus all format packets */
+#define CACHE_DATA_LEN	(MAX_TEXT_SEGS * MAX_PKT_LEN + \
+			MAX_FORMAT_OPTS * (MSG_F_SIZE + 1))
+
+/* encoded M and F packets for one sign */
+typedef struct cache_entry_t {
+	uint32_t last_used;	/* 0 = empty */
+	uint32_t hash;		/* of the text */
+
+	/* key */
+	struct ctlr_cfg_t ctlr;
+	struct sign_caps_t caps;
+	uint8_t address;
+	struct text_pos_t pos;
+	uint8_t num_fmts;
+	struct text_fmt_t fmt[MAX_FORMAT_OPTS];
+	char text[MAX_TEXT_LEN + 1];
+
+	/* finished packets, checksums included */
+	char data[CACHE_DATA_LEN];
+	uint16_t len;
+} cache_entry_t;
+
+/* least recently used cache of encoded packet sets */
+typedef struct text_cache_t {
+	struct cache_entry_t entry[CACHE_ENTRIES];
+	uint32_t use_count;
+
+	/* statistics */
+	uint32_t hits;
+	uint32_t misses;
+} text_cache_t;
+
+extern void cache_init(struct text_cache_t *cache);
+extern int8_t make_text_cached(struct text_cache_t *cache,
+	struct ctlr_cfg_t ctlr, struct sign_caps_t caps,
+	struct data_buf_t *buf, uint8_t address, struct text_pos_t pos,
+	char *text, struct text_fmt_t *fmt, uint8_t num_fmts);
@@ -0,0 +1,163 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * UTF-8 to sign character set transcoding
+ *
+ * The sign only has glyphs for printable ASCII, so everything else is
+ * mapped to the closest ASCII character. The output has exactly one
+ * byte per glyph which keeps the segment math in text.c simple.
+ */
+
+#include "common.h"
+#include "charset.h"
+
+/* sequence length by the upper nibble of the lead byte (0 = invalid) */
+static const uint8_t utf8_seq_len[16] = {
+	1, 1, 1, 1, 1, 1, 1, 1,	/* 0xxxxxxx: ASCII */
+	0, 0, 0, 0,		/* 10xxxxxx: stray continuation byte */
+	2, 2,			/* 110xxxxx */
+	3,			/* 1110xxxx */
+	4			/* 11110xxx */
+};
+
+/* payload bits of the lead byte by sequence length */
+static const uint8_t utf8_lead_mask[5] = {
+	0x00, 0x7f, 0x1f, 0x0f, 0x07
+};
+
+/* smallest code point each sequence length may encode */
+static const uint32_t utf8_min_code[5] = {
+	0, 0, 0x80, 0x800, 0x10000
+};
+
+/* glyphs for U+00A0 - U+00FF (Latin-1 supplement) */
+static const char latin1_glyphs[96] =
+	" !cL$Y|S\"ca<--R-"	/* U+00A0 */
+	"o+23'uP.,1o>????"	/* U+00B0 */
+	"AAAAAAACEEEEIIII"	/* U+00C0 */
+	"DNOOOOOxOUUUUYTs"	/* U+00D0 */
+	"aaaaaaaceeeeiiii"	/* U+00E0 */
+	"dnooooo/ouuuuyty";	/* U+00F0 */
+
+/* glyphs for other commonly used code points */
+static const struct {
+	uint16_t code;
+	char glyph;
+} extra_glyphs[] = {
+	{0x0152, 'O'}, {0x0153, 'o'},	/* OE ligatures */
+	{0x0160, 'S'}, {0x0161, 's'},
+	{0x0178, 'Y'},
+	{0x017d, 'Z'}, {0x017e, 'z'},
+	{0x2010, '-'}, {0x2011, '-'}, {0x2012, '-'},
+	{0x2013, '-'}, {0x2014, '-'}, {0x2015, '-'},
+	{0x2018, '\''}, {0x2019, '\''}, {0x201a, ','}, {0x201b, '\''},
+	{0x201c, '"'}, {0x201d, '"'}, {0x201e, '"'}, {0x201f, '"'},
+	{0x2022, '*'}, {0x2026, '.'},
+	{0x2039, '<'}, {0x203a, '>'},
+	{0x20ac, 'E'},			/* euro sign */
+	{0x2190, '<'}, {0x2192, '>'},	/* arrows */
+	{0x2212, '-'}			/* minus sign */
+};
+
+#define NUM_EXTRA_GLYPHS	(sizeof(extra_glyphs) / sizeof(extra_glyphs[0]))
+
+static char get_glyph(uint32_t code) {
+	uint16_t lo = 0;
+	uint16_t hi = NUM_EXTRA_GLYPHS;
+	uint16_t mid;
+
+	if (code >= 0x20 && code <= 0x7e) return (char)code;
+	/* treat control characters as spaces */
+	if (code < 0xa0) return ' ';
+	if (code <= 0xff) return latin1_glyphs[code - 0xa0];
+
+	/* binary search the extra table (sorted by code point) */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (extra_glyphs[mid].code == code)
+			return extra_glyphs[mid].glyph;
+		if (extra_glyphs[mid].code < code) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return GLYPH_FALLBACK;
+}
+
+/*
+ * convert a UTF-8 string to sign glyphs (one byte per glyph)
+ *
+ * malformed sequences become a single fallback glyph
+ * returns the number of glyphs written, excl. the terminating null, or
+ * -1 if they did not all fit
+ */
+int16_t utf8_to_glyphs(char *out, uint16_t out_size, char *in) {
+	const uint8_t *src = (const uint8_t *)in;
+	uint16_t glyphs = 0;
+	uint32_t code;
+	uint8_t seq_len;
+	uint8_t i;
+
+	if (!out_size) return -1;
+
+	while (*src && glyphs < out_size - 1) {
+		seq_len = utf8_seq_len[*src >> 4];
+
+		/* lone continuation byte, or a lead byte past U+10FFFF */
+		if (!seq_len || *src >= 0xf5) {
+			out[glyphs++] = GLYPH_FALLBACK;
+			src++;
+			continue;
+		}
+
+		code = *src & utf8_lead_mask[seq_len];
+		for (i = 1; i < seq_len; i++) {
+			/* truncated sequence */
+			if ((src[i] & 0xc0) != 0x80) break;
+			code = (code << 6) | (src[i] & 0x3f);
+		}
+
+		if (i < seq_len) {
+			out[glyphs++] = GLYPH_FALLBACK;
+			src += i;
+			continue;
+		}
+
+		/* overlong forms, UTF-16 surrogates and out of range */
+		if (code < utf8_min_code[seq_len] ||
+			(code >= 0xd800 && code <= 0xdfff) || code > 0x10ffff) {
+			out[glyphs++] = GLYPH_FALLBACK;
+			src += seq_len;
+			continue;
+		}
+
+		out[glyphs++] = get_glyph(code);
+		src += seq_len;
+	}
+
+	out[glyphs] = 0;
+
+	/* never cut text short without saying so */
+	if (*src) return -1;
+
+	return glyphs;
+}
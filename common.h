@@ -17,6 +17,9 @@
  *
  */
 
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
@@ -29,7 +32,35 @@
 #include <time.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <dirent.h>
+#include <linux/serial.h>
+#include <limits.h>
 
 #define VERSION "1.1.1"
 
+/* buffer sizes and limits can be overridden at compile time */
+#ifndef BUF_LEN
 #define BUF_LEN	512
+#endif
+
+/*
+ * logging can be compiled out for small targets
+ * (the dead call keeps the arguments "used" without generating code)
+ */
+#ifdef NO_LOG
+#define log_msg(...)	do { if (0) printf(__VA_ARGS__); } while (0)
+#define log_err(...)	do { if (0) fprintf(stderr, __VA_ARGS__); } while (0)
+#else
+#define log_msg(...)	printf(__VA_ARGS__)
+#define log_err(...)	fprintf(stderr, __VA_ARGS__)
+#endif
@@ -0,0 +1,478 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * sign topology configuration file
+ *
+ * One directive per line, '#' starts a comment line:
+ *
+ *   port <name> <device>
+ *   ctlr <name> <mid>,<extPid>,<pid>
+ *   timing <name> [width=<glyphs>] [dwell=<ms>] [scroll=<ms>]
+ *   caps <name> [seg=<glyphs>] [segs=<n>]
+ *   format <name>,<value>
+ *   sign <port> <address> [ctlr=<name>] [timing=<name>] [caps=<name>]
+ *	[format=<name>,<value> ...] [reset=1] [line=<n>] [pos=<h>,<v>]
+ *	<text>
+ *
+ * Signs use the first ctlr, timing and caps entries unless told otherwise,
+ * and the format lines unless they list their own formats. A sign may
+ * have several entries for different lines or regions, each one is
+ * updated on its own. The text may contain template fields, see
+ * template.c, and several messages separated by "||" that the sign
+ * rotates through, each shown for as long as the timing says.
+ */
+
+#include "common.h"
+#include "packet.h"
+#include "serial.h"
+#include "charset.h"
+#include "text.h"
+#include "display.h"
+#include "config.h"
+#include "template.h"
+
+void config_init(struct nxtp_config_t *cfg) {
+	memset(cfg, 0, sizeof(struct nxtp_config_t));
+}
+
+/*
+ * returns the index of the new port
+ *
+ */
+int8_t config_add_port(struct nxtp_config_t *cfg, char *name, char *path) {
+	struct port_cfg_t *port;
+
+	if (cfg->num_ports == MAX_PORTS) return -1;
+
+	port = &cfg->port[cfg->num_ports];
+	strncpy(port->name, name, NAME_LEN - 1);
+	strncpy(port->path, path, PORT_SIZE - 1);
+
+	return cfg->num_ports++;
+}
+
+struct sign_cfg_t *config_add_sign(struct nxtp_config_t *cfg,
+	uint8_t port, uint8_t address) {
+	struct sign_cfg_t *sign;
+
+	if (cfg->num_signs == MAX_SIGNS) return NULL;
+
+	sign = &cfg->sign[cfg->num_signs++];
+	sign->port = port;
+	sign->address = address;
+	set_text_pos(&sign->pos, 1, 1, 1);
+	set_ctlr_config(&sign->ctlr,
+		DEFAULT_MID, DEFAULT_EXT_PID, DEFAULT_PID);
+	display_model_init(&sign->timing);
+	sign_caps_init(&sign->caps);
+
+	return sign;
+}
+
+/*
+ * parse "name,value" where value is a number or a character
+ *
+ */
+int8_t config_parse_format(char *str, struct text_fmt_t *fmt) {
+	if (sscanf(str, "%c,%hhu", &fmt->name, &fmt->value) == 2) return 1;
+	if (sscanf(str, "%c,%c", &fmt->name, &fmt->value) == 2) return 1;
+
+	return -1;
+}
+
+static int8_t find_port(struct nxtp_config_t *cfg, char *name) {
+	for (uint8_t i = 0; i < cfg->num_ports; i++) {
+		if (strcmp(cfg->port[i].name, name) == 0) return i;
+	}
+
+	return -1;
+}
+
+static int8_t find_ctlr(struct nxtp_config_t *cfg, char *name) {
+	for (uint8_t i = 0; i < cfg->num_ctlrs; i++) {
+		if (strcmp(cfg->ctlr[i].name, name) == 0) return i;
+	}
+
+	return -1;
+}
+
+static int8_t parse_ctlr(struct nxtp_config_t *cfg, char *args) {
+	struct ctlr_entry_t *entry;
+
+	if (cfg->num_ctlrs == MAX_CTLRS) return -1;
+	entry = &cfg->ctlr[cfg->num_ctlrs];
+
+	if (sscanf(args, "%15s %hhu,%hhu,%hhu", entry->name,
+		&entry->ctlr.mid, &entry->ctlr.ext_pid,
+		&entry->ctlr.pid) != 4) return -1;
+
+	cfg->num_ctlrs++;
+
+	return 1;
+}
+
+static int8_t find_timing(struct nxtp_config_t *cfg, char *name) {
+	for (uint8_t i = 0; i < cfg->num_timings; i++) {
+		if (strcmp(cfg->timing[i].name, name) == 0) return i;
+	}
+
+	return -1;
+}
+
+/*
+ * timing <name> [key=value ...]
+ *
+ * unset values keep the defaults from display.h
+ */
+static int8_t parse_timing(struct nxtp_config_t *cfg, char *args) {
+	struct timing_entry_t *entry;
+	char token[64];
+	int pos;
+
+	if (cfg->num_timings == MAX_TIMINGS) return -1;
+	entry = &cfg->timing[cfg->num_timings];
+	display_model_init(&entry->model);
+
+	if (sscanf(args, "%15s %n", entry->name, &pos) != 1) return -1;
+	if (find_timing(cfg, entry->name) >= 0) return -1;
+	args += pos;
+
+	while (sscanf(args, "%63s %n", token, &pos) == 1) {
+		if (strncmp(token, "width=", 6) == 0) {
+			entry->model.width = strtoul(token + 6, NULL, 10);
+			if (!entry->model.width) return -1;
+		} else if (strncmp(token, "dwell=", 6) == 0) {
+			entry->model.dwell_ms = strtoul(token + 6, NULL, 10);
+		} else if (strncmp(token, "scroll=", 7) == 0) {
+			entry->model.scroll_ms = strtoul(token + 7, NULL, 10);
+		} else {
+			return -1;
+		}
+		args += pos;
+	}
+
+	cfg->num_timings++;
+
+	return 1;
+}
+
+static int8_t find_caps(struct nxtp_config_t *cfg, char *name) {
+	for (uint8_t i = 0; i < cfg->num_caps; i++) {
+		if (strcmp(cfg->caps[i].name, name) == 0) return i;
+	}
+
+	return -1;
+}
+
+/*
+ * caps <name> [key=value ...]
+ *
+ * unset values keep what every sign takes
+ */
+static int8_t parse_caps(struct nxtp_config_t *cfg, char *args) {
+	struct caps_entry_t *entry;
+	char token[64];
+	int pos;
+
+	if (cfg->num_caps == MAX_CAPS) return -1;
+	entry = &cfg->caps[cfg->num_caps];
+	sign_caps_init(&entry->caps);
+
+	if (sscanf(args, "%15s %n", entry->name, &pos) != 1) return -1;
+	if (find_caps(cfg, entry->name) >= 0) return -1;
+	args += pos;
+
+	while (sscanf(args, "%63s %n", token, &pos) == 1) {
+		if (strncmp(token, "seg=", 4) == 0) {
+			entry->caps.seg_len = strtoul(token + 4, NULL, 10);
+		} else if (strncmp(token, "segs=", 5) == 0) {
+			entry->caps.max_segs = strtoul(token + 5, NULL, 10);
+		} else {
+			return -1;
+		}
+		args += pos;
+	}
+
+	if (check_sign_caps(entry->caps) < 0) return -1;
+
+	cfg->num_caps++;
+
+	return 1;
+}
+
+/*
+ * sign <port> <address> [key=value ...] <text>
+ *
+ * the own_* flags tell the caller which defaults still apply
+ */
+static int8_t parse_sign(struct nxtp_config_t *cfg, char *args,
+	uint8_t *own_ctlr, uint8_t *own_timing, uint8_t *own_caps,
+	uint8_t *own_fmts) {
+	struct sign_cfg_t *sign;
+	char port[NAME_LEN];
+	char token[64];
+	unsigned int address;
+	int8_t idx;
+	int pos;
+
+	if (sscanf(args, "%15s %u%n", port, &address, &pos) != 2) return -1;
+	if (address > 255) return -1;
+	args += pos;
+
+	idx = find_port(cfg, port);
+	if (idx < 0) return -1;
+
+	sign = config_add_sign(cfg, idx, address);
+	if (!sign) return -1;
+
+	*own_ctlr = 0;
+	*own_timing = 0;
+	*own_caps = 0;
+	*own_fmts = 0;
+
+	/* options come first, the rest of the line is the text */
+	while (sscanf(args, " %63s%n", token, &pos) == 1) {
+		if (strncmp(token, "ctlr=", 5) == 0) {
+			idx = find_ctlr(cfg, token + 5);
+			if (idx < 0) return -1;
+			sign->ctlr = cfg->ctlr[idx].ctlr;
+			*own_ctlr = 1;
+		} else if (strncmp(token, "timing=", 7) == 0) {
+			idx = find_timing(cfg, token + 7);
+			if (idx < 0) return -1;
+			sign->timing = cfg->timing[idx].model;
+			*own_timing = 1;
+		} else if (strncmp(token, "caps=", 5) == 0) {
+			idx = find_caps(cfg, token + 5);
+			if (idx < 0) return -1;
+			sign->caps = cfg->caps[idx].caps;
+			*own_caps = 1;
+		} else if (strncmp(token, "format=", 7) == 0) {
+			if (sign->num_fmts == MAX_FORMAT_OPTS) return -1;
+			if (config_parse_format(token + 7,
+				&sign->fmt[sign->num_fmts]) < 0) return -1;
+			sign->num_fmts++;
+			*own_fmts = 1;
+		} else if (strncmp(token, "reset=", 6) == 0) {
+			sign->reset = strtoul(token + 6, NULL, 10) ? 1 : 0;
+		} else if (strncmp(token, "line=", 5) == 0) {
+			sign->pos.line = strtoul(token + 5, NULL, 10);
+			if (!sign->pos.line) return -1;
+		} else if (strncmp(token, "pos=", 4) == 0) {
+			if (sscanf(token + 4, "%hhu,%hhu",
+				&sign->pos.h, &sign->pos.v) != 2) return -1;
+			if (!sign->pos.h || sign->pos.h > TEXT_POS_MAX ||
+				!sign->pos.v || sign->pos.v > TEXT_POS_MAX)
+				return -1;
+		} else {
+			break;
+		}
+		args += pos;
+	}
+
+	/* one blank separates the text, the ones after it align it */
+	if (*args == ' ' || *args == '\t') args++;
+
+	/* each region of a sign may only appear once */
+	for (uint8_t i = 0; i < cfg->num_signs - 1; i++) {
+		if (cfg->sign[i].port == sign->port &&
+			sign_cfg_same_region(&cfg->sign[i], sign)) return -1;
+	}
+
+	strncpy(sign->text, args[0] ? args : " ", sizeof(sign->text) - 1);
+
+	return template_check(sign->text);
+}
+
+/*
+ * load a configuration file
+ *
+ * the contents of cfg are undefined on failure, so load into a scratch
+ * copy to keep a running configuration alive across a bad edit
+ */
+int8_t config_load(struct nxtp_config_t *cfg, char *path) {
+	uint8_t own_ctlr[MAX_SIGNS];
+	uint8_t own_timing[MAX_SIGNS];
+	uint8_t own_caps[MAX_SIGNS];
+	uint8_t own_fmts[MAX_SIGNS];
+	char line[CONFIG_LINE_LEN];
+	char keyword[16];
+	char name[NAME_LEN];
+	char dev[PORT_SIZE];
+	uint16_t line_num = 0;
+	size_t len;
+	int8_t ret;
+	int pos;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		log_err("(%s): Couldn't open %s: %d (%s)\n",
+			__func__, path, -errno, strerror(errno));
+		return -1;
+	}
+
+	config_init(cfg);
+
+	while (fgets(line, CONFIG_LINE_LEN, f)) {
+		line_num++;
+
+		/* strip the line ending and trailing blanks */
+		len = strlen(line);
+		while (len && (line[len - 1] == '\n' || line[len - 1] == '\r' ||
+			line[len - 1] == ' ' || line[len - 1] == '\t'))
+			line[--len] = 0;
+
+		if (sscanf(line, "%15s %n", keyword, &pos) != 1) continue;
+		if (keyword[0] == '#') continue;
+
+		if (strcmp(keyword, "port") == 0) {
+			ret = -1;
+			if (sscanf(line + pos, "%15s %127s", name, dev) == 2 &&
+				find_port(cfg, name) < 0)
+				ret = config_add_port(cfg, name, dev);
+		} else if (strcmp(keyword, "ctlr") == 0) {
+			ret = parse_ctlr(cfg, line + pos);
+		} else if (strcmp(keyword, "timing") == 0) {
+			ret = parse_timing(cfg, line + pos);
+		} else if (strcmp(keyword, "caps") == 0) {
+			ret = parse_caps(cfg, line + pos);
+		} else if (strcmp(keyword, "format") == 0) {
+			ret = -1;
+			if (cfg->num_fmts < MAX_FORMAT_OPTS)
+				ret = config_parse_format(line + pos,
+					&cfg->fmt[cfg->num_fmts++]);
+		} else if (strcmp(keyword, "sign") == 0) {
+			ret = parse_sign(cfg, line + pos,
+				&own_ctlr[cfg->num_signs],
+				&own_timing[cfg->num_signs],
+				&own_caps[cfg->num_signs],
+				&own_fmts[cfg->num_signs]);
+		} else {
+			ret = -1;
+		}
+
+		if (ret < 0) {
+			log_err("%s:%u: Invalid line \"%s\".\n",
+				path, line_num, line);
+			fclose(f);
+			return -1;
+		}
+	}
+
+	fclose(f);
+
+	/* apply the defaults */
+	for (uint8_t i = 0; i < cfg->num_signs; i++) {
+		if (!own_ctlr[i] && cfg->num_ctlrs)
+			cfg->sign[i].ctlr = cfg->ctlr[0].ctlr;
+		if (!own_timing[i] && cfg->num_timings)
+			cfg->sign[i].timing = cfg->timing[0].model;
+		if (!own_caps[i] && cfg->num_caps)
+			cfg->sign[i].caps = cfg->caps[0].caps;
+		if (!own_fmts[i]) {
+			cfg->sign[i].num_fmts = cfg->num_fmts;
+			memcpy(cfg->sign[i].fmt, cfg->fmt,
+				cfg->num_fmts * sizeof(struct text_fmt_t));
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * number of messages a sign rotates through, 1 if it does not rotate
+ *
+ */
+uint8_t config_num_messages(char *text) {
+	uint8_t num = 1;
+
+	while ((text = strstr(text, ROTATE_SEP))) {
+		text += strlen(ROTATE_SEP);
+		num++;
+	}
+
+	return num;
+}
+
+/*
+ * copy one message of a rotation
+ *
+ */
+void config_get_message(char *text, uint8_t idx, char *out,
+	uint16_t out_size) {
+	char *end;
+	uint16_t len;
+
+	for (; idx; idx--) {
+		text = strstr(text, ROTATE_SEP);
+		if (!text) {
+			out[0] = 0;
+			return;
+		}
+		text += strlen(ROTATE_SEP);
+	}
+
+	end = strstr(text, ROTATE_SEP);
+	len = end ? (uint16_t)(end - text) : strlen(text);
+	if (len > out_size - 1) len = out_size - 1;
+
+	memcpy(out, text, len);
+	out[len] = 0;
+}
+
+/*
+ * do both entries describe the same line or region of the same sign?
+ *
+ */
+uint8_t sign_cfg_same_region(struct sign_cfg_t *a, struct sign_cfg_t *b) {
+	return a->address == b->address && a->pos.line == b->pos.line &&
+		a->pos.h == b->pos.h && a->pos.v == b->pos.v;
+}
+
+/*
+ * compare everything but the port, which is matched by name instead
+ *
+ */
+uint8_t sign_cfg_equal(struct sign_cfg_t *a, struct sign_cfg_t *b) {
+	if (!sign_cfg_same_region(a, b) || a->reset != b->reset) return 0;
+
+	if (a->timing.width != b->timing.width ||
+		a->timing.dwell_ms != b->timing.dwell_ms ||
+		a->timing.scroll_ms != b->timing.scroll_ms)
+		return 0;
+
+	if (a->caps.seg_len != b->caps.seg_len ||
+		a->caps.max_segs != b->caps.max_segs)
+		return 0;
+
+	if (a->ctlr.mid != b->ctlr.mid || a->ctlr.ext_pid != b->ctlr.ext_pid ||
+		a->ctlr.pid != b->ctlr.pid)
+		return 0;
+
+	if (a->num_fmts != b->num_fmts) return 0;
+	for (uint8_t i = 0; i < a->num_fmts; i++) {
+		if (a->fmt[i].name != b->fmt[i].name ||
+			a->fmt[i].value != b->fmt[i].value)
+			return 0;
+	}
+
+	return strcmp(a->text, b->text) == 0;
+}
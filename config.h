@@ -0,0 +1,103 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MAX_PORTS
+#define MAX_PORTS	4
+#endif
+#ifndef MAX_SIGNS
+#define MAX_SIGNS	32
+#endif
+#define MAX_CTLRS	8
+#define MAX_TIMINGS	8
+#define MAX_CAPS	8
+#define NAME_LEN	16
+#define CONFIG_LINE_LEN	1024
+
+/* default sign controller configuration */
+#define DEFAULT_MID	195
+#define DEFAULT_EXT_PID	255
+#define DEFAULT_PID	245
+
+typedef struct port_cfg_t {
+	char name[NAME_LEN];
+	char path[PORT_SIZE];
+} port_cfg_t;
+
+typedef struct ctlr_entry_t {
+	char name[NAME_LEN];
+	struct ctlr_cfg_t ctlr;
+} ctlr_entry_t;
+
+typedef struct timing_entry_t {
+	char name[NAME_LEN];
+	struct display_model_t model;
+} timing_entry_t;
+
+typedef struct caps_entry_t {
+	char name[NAME_LEN];
+	struct sign_caps_t caps;
+} caps_entry_t;
+
+/* separates the messages of a sign that rotates through several */
+#define ROTATE_SEP	"||"
+
+typedef struct sign_cfg_t {
+	uint8_t port;		/* index into the port list */
+	uint8_t address;
+	struct text_pos_t pos;	/* line or region of the sign */
+	struct ctlr_cfg_t ctlr;
+	uint8_t num_fmts;
+	struct text_fmt_t fmt[MAX_FORMAT_OPTS];
+	uint8_t reset;		/* reset the sign before sending text */
+	struct display_model_t timing;
+	struct sign_caps_t caps;
+	/* raw UTF-8 text, may be a template or a rotation */
+	char text[MAX_TEXT_LEN * MAX_UTF8_LEN + 1];
+} sign_cfg_t;
+
+/* sign topology */
+typedef struct nxtp_config_t {
+	uint8_t num_ports;
+	struct port_cfg_t port[MAX_PORTS];
+	uint8_t num_ctlrs;
+	struct ctlr_entry_t ctlr[MAX_CTLRS];
+	uint8_t num_timings;
+	struct timing_entry_t timing[MAX_TIMINGS];
+	uint8_t num_caps;
+	struct caps_entry_t caps[MAX_CAPS];
+	/* default formats */
+	uint8_t num_fmts;
+	struct text_fmt_t fmt[MAX_FORMAT_OPTS];
+	uint8_t num_signs;
+	struct sign_cfg_t sign[MAX_SIGNS];
+} nxtp_config_t;
+
+extern void config_init(struct nxtp_config_t *cfg);
+extern int8_t config_add_port(struct nxtp_config_t *cfg,
+	char *name, char *path);
+extern struct sign_cfg_t *config_add_sign(struct nxtp_config_t *cfg,
+	uint8_t port, uint8_t address);
+extern int8_t config_parse_format(char *str, struct text_fmt_t *fmt);
+extern int8_t config_load(struct nxtp_config_t *cfg, char *path);
+extern uint8_t config_num_messages(char *text);
+extern void config_get_message(char *text, uint8_t idx, char *out,
+	uint16_t out_size);
+extern uint8_t sign_cfg_same_region(struct sign_cfg_t *a,
+	struct sign_cfg_t *b);
+extern uint8_t sign_cfg_equal(struct sign_cfg_t *a, struct sign_cfg_t *b);
@@ -0,0 +1,195 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * sign address discovery
+ *
+ * A request parameter packet has no address, every sign on the bus
+ * answers it with a data link escape packet that carries its own
+ * address and state. So instead of probing 256 addresses one by one,
+ * probes are broadcast and all replies are collected at once. A round
+ * ends as soon as the bus stays quiet for a short while after the last
+ * reply. Replies lost to collisions turn up in the next round, and the
+ * scan stops after a few rounds without new signs.
+ */
+
+#include "common.h"
+#include "packet.h"
+#include "serial.h"
+#include "budget.h"
+#include "busmon.h"
+#include "discover.h"
+
+#define SIGN_MID	189
+
+typedef struct discover_obj_t {
+	struct serialport_t port;
+	char buf[BUF_LEN];
+	struct bus_monitor_t mon;
+	struct sign_info_t sign[256];
+	uint8_t new_signs;
+	uint8_t num_signs;
+} discover_obj_t;
+
+static uint64_t get_us() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* pick the replies out of everything on the bus */
+static void on_frame(void *arg, uint8_t *frame, uint8_t len,
+	uint8_t valid, uint64_t gap_us) {
+	struct discover_obj_t *obj = (struct discover_obj_t *)arg;
+	struct sign_info_t *sign;
+	struct msg_dle_t dle;
+
+	(void)gap_us;
+
+	/* page 2 data link escape from a sign */
+	if (!valid || len < MSG_DLE_SIZE || frame[0] != SIGN_MID ||
+		frame[1] != 255 || frame[2] != 254) return;
+
+	read_dle_pkt((char *)frame, len, &dle);
+
+	sign = &obj->sign[dle.address];
+	if (!sign->found) {
+		sign->found = 1;
+		obj->new_signs++;
+		obj->num_signs++;
+	}
+	sign->replies++;
+	sign->dle = dle;
+}
+
+/*
+ * send a probe and collect replies until the bus goes quiet
+ *
+ */
+static int8_t probe(struct discover_obj_t *obj, struct ctlr_cfg_t ctlr) {
+	struct data_buf_t data_buf;
+	struct pollfd pfd;
+	uint64_t now;
+	uint64_t end;
+	uint64_t round_end;
+	int ret;
+
+	serial_claim_buffer(&obj->port, &data_buf);
+	data_buf.len = make_rp_pkt(data_buf.data, ctlr);
+	serial_commit_buffer(&obj->port, &data_buf);
+	if (serial_send(&obj->port) < 0) return -1;
+
+	now = get_us();
+	end = now + DISCOVER_FIRST_MS * 1000;
+	round_end = now + DISCOVER_ROUND_MS * 1000;
+
+	pfd.fd = obj->port.fd;
+	pfd.events = POLLIN;
+
+	while ((now = get_us()) < end) {
+		ret = poll(&pfd, 1, (end - now + 999) / 1000);
+		if (ret < 0 && errno != EINTR) return -1;
+		if (ret <= 0) continue;
+
+		if (serial_receive(&obj->port) < 0) return -1;
+
+		/* the other end hung up, nothing more will come */
+		if (!obj->port.buf_len) {
+			log_err("Port %s closed while probing.\n",
+				obj->port.port);
+			return -1;
+		}
+
+		now = get_us();
+		busmon_feed(&obj->mon, (uint8_t *)obj->port.buf,
+			obj->port.buf_len, now);
+
+		/* wait a little longer after every reply */
+		end = now + DISCOVER_NEXT_MS * 1000;
+		if (end > round_end) end = round_end;
+	}
+
+	busmon_flush(&obj->mon, UINT64_MAX);
+
+	return 1;
+}
+
+static void print_inventory(struct discover_obj_t *obj, uint64_t took) {
+	struct msg_dle_t *dle;
+
+	printf("Found %u sign%s in %lu ms.\n", obj->num_signs,
+		obj->num_signs == 1 ? "" : "s", (unsigned long)(took / 1000));
+	if (!obj->num_signs) return;
+
+	printf("Address  State  Host  Text map  Formats  Aux  Replies\n");
+	for (uint16_t i = 0; i < 256; i++) {
+		if (!obj->sign[i].found) continue;
+
+		dle = &obj->sign[i].dle;
+		printf("%7u  %5c  %4u  %02x%02x      %02x       %c    %7u\n",
+			i, dle->state, dle->host_mid, dle->tbmu, dle->tbml,
+			dle->fbm, dle->aux_state, obj->sign[i].replies);
+	}
+}
+
+/*
+ * find the signs on a bus and print what they report
+ *
+ */
+int8_t run_discovery(char *port, struct ctlr_cfg_t ctlr) {
+	static struct discover_obj_t obj;
+	uint64_t start;
+	uint8_t quiet = 0;
+	int8_t ret = 1;
+
+	if (serial_open_port(&obj.port, port, obj.buf, BUF_LEN) < 0)
+		return -1;
+
+	if (obj.port.fd < 0) {
+		log_err("Port %s can't be read from.\n", port);
+		serial_close_port(&obj.port);
+		return -1;
+	}
+
+	/* not every driver supports this */
+	serial_set_low_latency(&obj.port);
+
+	/* throw away whatever was on the line before */
+	tcflush(obj.port.fd, TCIFLUSH);
+
+	start = get_us();
+	busmon_init(&obj.mon, BUS_BAUD, start, on_frame, &obj);
+
+	for (uint8_t round = 0; round < DISCOVER_ROUNDS &&
+		quiet < DISCOVER_QUIET_ROUNDS; round++) {
+		obj.new_signs = 0;
+		if (probe(&obj, ctlr) < 0) {
+			ret = -1;
+			break;
+		}
+		quiet = obj.new_signs ? 0 : quiet + 1;
+	}
+
+	print_inventory(&obj, get_us() - start);
+	serial_close_port(&obj.port);
+
+	return ret;
+}
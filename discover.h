@@ -0,0 +1,36 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* probe rounds, stop early once this many bring no new signs */
+#define DISCOVER_ROUNDS		8
+#define DISCOVER_QUIET_ROUNDS	2
+
+/* time for the first reply to a probe, then for each next one */
+#define DISCOVER_FIRST_MS	60
+#define DISCOVER_NEXT_MS	30
+#define DISCOVER_ROUND_MS	500
+
+/* sign found on the bus */
+typedef struct sign_info_t {
+	uint8_t found;
+	uint8_t replies;
+	struct msg_dle_t dle;	/* last reply */
+} sign_info_t;
+
+extern int8_t run_discovery(char *port, struct ctlr_cfg_t ctlr);
@@ -0,0 +1,57 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * display timing model
+ *
+ * Used to line up rotating messages so the next one goes out right as
+ * the sign is done with the current one.
+ */
+
+#include "common.h"
+#include "packet.h"
+#include "display.h"
+
+void display_model_init(struct display_model_t *model) {
+	model->width = DISPLAY_WIDTH;
+	model->dwell_ms = DISPLAY_DWELL_MS;
+	model->scroll_ms = DISPLAY_SCROLL_MS;
+}
+
+/*
+ * milliseconds a message with this many glyphs is visible for
+ *
+ */
+uint32_t display_time(struct display_model_t *model, uint16_t num_glyphs) {
+	if (num_glyphs <= model->width) return model->dwell_ms;
+
+	return (uint32_t)(num_glyphs + model->width) * model->scroll_ms;
+}
+
+/*
+ * bytes needed to upload and show a message, M packets and trigger
+ *
+ */
+uint16_t display_upload_len(struct sign_caps_t *caps, uint16_t num_glyphs) {
+	uint16_t num_segs = (num_glyphs + caps->seg_len - 1) / caps->seg_len;
+
+	if (!num_segs) num_segs = 1;
+
+	return num_glyphs + num_segs * (MSG_M_SIZE + 1) + MSG_T_SIZE + 1;
+}
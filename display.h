@@ -0,0 +1,43 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* defaults for a 16 glyph front sign, calibrate with a timing entry */
+#define DISPLAY_WIDTH		16	/* glyphs visible at once */
+#define DISPLAY_DWELL_MS	4000	/* text that fits */
+#define DISPLAY_SCROLL_MS	120	/* per glyph moved */
+
+/*
+ * how long a sign takes to show a message
+ *
+ * Text that fits stays up for the dwell time. Longer text scrolls in
+ * from the right edge until its last glyph has left on the left, one
+ * glyph per scroll step. Measure both once per sign type and format
+ * settings, as the format can change the scroll speed.
+ */
+typedef struct display_model_t {
+	uint8_t width;
+	uint16_t dwell_ms;
+	uint16_t scroll_ms;
+} display_model_t;
+
+extern void display_model_init(struct display_model_t *model);
+extern uint32_t display_time(struct display_model_t *model,
+	uint16_t num_glyphs);
+extern uint16_t display_upload_len(struct sign_caps_t *caps,
+	uint16_t num_glyphs);
@@ -0,0 +1,105 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * epoll based event loop
+ *
+ * signals, timers and serial ports are all file descriptors here
+ * (signalfd, timerfd, tty) so the process sleeps until one of them
+ * is ready instead of polling
+ */
+
+#include "common.h"
+#include "loop.h"
+
+int8_t loop_init(struct loop_t *loop) {
+	loop->running = 0;
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd < 0) {
+		log_err("(%s): Couldn't create epoll instance: %d (%s)\n",
+			__func__, -errno, strerror(errno));
+		return -1;
+	}
+
+	return 1;
+}
+
+int8_t loop_add(struct loop_t *loop, struct loop_handler_t *handler) {
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.ptr = handler;
+
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, handler->fd, &ev) < 0) {
+		log_err("(%s): Couldn't watch fd %d: %d (%s)\n",
+			__func__, handler->fd, -errno, strerror(errno));
+		return -1;
+	}
+
+	return 1;
+}
+
+int8_t loop_del(struct loop_t *loop, struct loop_handler_t *handler) {
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_DEL, handler->fd, NULL) < 0) {
+		log_err("(%s): Couldn't unwatch fd %d: %d (%s)\n",
+			__func__, handler->fd, -errno, strerror(errno));
+		return -1;
+	}
+
+	return 1;
+}
+
+/*
+ * dispatch events until loop_stop() is called from a handler
+ *
+ */
+void loop_run(struct loop_t *loop) {
+	struct epoll_event events[LOOP_MAX_EVENTS];
+	struct loop_handler_t *handler;
+	int num_events;
+
+	loop->running = 1;
+
+	while (loop->running) {
+		num_events = epoll_wait(loop->epfd, events,
+			LOOP_MAX_EVENTS, -1);
+		if (num_events < 0) {
+			if (errno == EINTR) continue;
+			log_err("(%s): epoll_wait failed: %d (%s)\n",
+				__func__, -errno, strerror(errno));
+			break;
+		}
+
+		for (int i = 0; i < num_events && loop->running; i++) {
+			handler = (struct loop_handler_t *)events[i].data.ptr;
+			handler->cb(handler->arg);
+		}
+	}
+
+	loop->running = 0;
+}
+
+void loop_stop(struct loop_t *loop) {
+	loop->running = 0;
+}
+
+void loop_close(struct loop_t *loop) {
+	close(loop->epfd);
+}
@@ -0,0 +1,42 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define LOOP_MAX_EVENTS	8
+
+typedef void (*loop_cb_t)(void *arg);
+
+/* file descriptor watched by the event loop */
+typedef struct loop_handler_t {
+	int fd;
+	loop_cb_t cb;
+	void *arg;
+} loop_handler_t;
+
+/* event loop object */
+typedef struct loop_t {
+	int epfd;
+	uint8_t running;
+} loop_t;
+
+extern int8_t loop_init(struct loop_t *loop);
+extern int8_t loop_add(struct loop_t *loop, struct loop_handler_t *handler);
+extern int8_t loop_del(struct loop_t *loop, struct loop_handler_t *handler);
+extern void loop_run(struct loop_t *loop);
+extern void loop_stop(struct loop_t *loop);
+extern void loop_close(struct loop_t *loop);
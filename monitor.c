@@ -0,0 +1,223 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * passive bus monitor mode
+ *
+ * The port is only ever read from. Every frame is printed as it is
+ * decoded and the traffic statistics are printed on SIGUSR1 and on
+ * exit.
+ */
+
+#include "common.h"
+#include "packet.h"
+#include "serial.h"
+#include "budget.h"
+#include "busmon.h"
+#include "loop.h"
+#include "monitor.h"
+
+typedef struct monitor_obj_t {
+	struct serialport_t port;
+	char buf[BUF_LEN];
+	struct bus_monitor_t mon;
+
+	struct loop_t loop;
+	struct loop_handler_t port_ev;
+	struct loop_handler_t signal_ev;
+	struct loop_handler_t timer_ev;
+} monitor_obj_t;
+
+static uint64_t get_us() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void print_frame(void *arg, uint8_t *frame, uint8_t len,
+	uint8_t valid, uint64_t gap_us) {
+	struct monitor_obj_t *obj = (struct monitor_obj_t *)arg;
+	uint64_t at = obj->mon.frame_start - obj->mon.start;
+
+	printf("%6lu.%06lu +%-7lu MID %3u %s", (unsigned long)(at / 1000000),
+		(unsigned long)(at % 1000000), (unsigned long)gap_us,
+		frame[0], valid ? "  " : "! ");
+	for (uint8_t i = 1; i < len; i++) printf(" %02x", frame[i]);
+	printf("\n");
+}
+
+static void print_stats(struct monitor_obj_t *obj) {
+	struct bus_monitor_t *mon = &obj->mon;
+	uint16_t load = busmon_load(mon, get_us());
+
+	printf("Bus load on %s: %u.%u%%, %lu bytes, %u frames, "
+		"%u bad.\n", obj->port.port, load / 10, load % 10,
+		(unsigned long)mon->bytes, mon->frames, mon->bad_frames);
+
+	for (uint16_t i = 0; i < 256; i++) {
+		if (!mon->mid_frames[i]) continue;
+		printf("  MID %3u: %u frames\n", i, mon->mid_frames[i]);
+	}
+
+	for (uint16_t i = 0; i < J1587_NUM_PIDS; i++) {
+		if (!mon->pid_count[i]) continue;
+		if (i < 256)
+			printf("  PID %3u: %u\n", i, mon->pid_count[i]);
+		else
+			printf("  PID %3u (page 2): %u\n", i - 256,
+				mon->pid_count[i]);
+	}
+
+	printf("Inter-frame gaps:\n");
+	for (uint8_t i = 0; i < BUSMON_GAP_BUCKETS; i++) {
+		if (i == BUSMON_GAP_BUCKETS - 1)
+			printf("  >= %4u ms: %u\n", 1 << (i - 1),
+				mon->gap_hist[i]);
+		else
+			printf("  <  %4u ms: %u\n", 1 << i,
+				mon->gap_hist[i]);
+	}
+}
+
+/* close the last frame when the bus goes quiet */
+static void arm_flush_timer(struct monitor_obj_t *obj) {
+	struct itimerspec its;
+	uint64_t deadline = busmon_deadline(&obj->mon);
+
+	memset(&its, 0, sizeof(struct itimerspec));
+	if (deadline) {
+		its.it_value.tv_sec = deadline / 1000000;
+		its.it_value.tv_nsec = deadline % 1000000 * 1000;
+	}
+
+	timerfd_settime(obj->timer_ev.fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void on_port_readable(void *arg) {
+	struct monitor_obj_t *obj = (struct monitor_obj_t *)arg;
+
+	if (serial_receive(&obj->port) < 0 || !obj->port.buf_len) {
+		log_err("Lost %s.\n", obj->port.port);
+		loop_stop(&obj->loop);
+		return;
+	}
+
+	busmon_feed(&obj->mon, (uint8_t *)obj->port.buf,
+		obj->port.buf_len, get_us());
+	arm_flush_timer(obj);
+}
+
+static void on_flush_timer(void *arg) {
+	struct monitor_obj_t *obj = (struct monitor_obj_t *)arg;
+	uint64_t expirations;
+
+	if (read(obj->timer_ev.fd, &expirations, sizeof(uint64_t)) < 0)
+		return;
+
+	busmon_flush(&obj->mon, get_us());
+	arm_flush_timer(obj);
+}
+
+static void on_signal(void *arg) {
+	struct monitor_obj_t *obj = (struct monitor_obj_t *)arg;
+	struct signalfd_siginfo info;
+
+	if (read(obj->signal_ev.fd, &info, sizeof(info)) < 0) return;
+
+	if (info.ssi_signo == SIGUSR1)
+		print_stats(obj);
+	else
+		loop_stop(&obj->loop);
+}
+
+/*
+ * watch the bus until SIGINT or SIGTERM
+ *
+ */
+int8_t run_monitor(char *port) {
+	static struct monitor_obj_t obj;
+	sigset_t sigs;
+	int8_t ret = -1;
+
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	sigaddset(&sigs, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &sigs, NULL);
+
+	if (serial_open_port(&obj.port, port, obj.buf, BUF_LEN) < 0)
+		return -1;
+
+	if (obj.port.fd < 0) {
+		log_err("Port %s can't be read from.\n", port);
+		serial_close_port(&obj.port);
+		return -1;
+	}
+
+	/* not every driver supports this, ptys do not */
+	if (serial_set_low_latency(&obj.port) < 0)
+		log_msg("No low latency mode on %s, frame gaps may be "
+			"blurred.\n", port);
+
+	busmon_init(&obj.mon, BUS_BAUD, get_us(), print_frame, &obj);
+
+	obj.signal_ev.fd = -1;
+	obj.timer_ev.fd = -1;
+	if (loop_init(&obj.loop) < 0) goto done;
+
+	obj.port_ev.fd = obj.port.fd;
+	obj.port_ev.cb = on_port_readable;
+	obj.port_ev.arg = &obj;
+
+	obj.signal_ev.fd = signalfd(-1, &sigs, SFD_CLOEXEC);
+	obj.signal_ev.cb = on_signal;
+	obj.signal_ev.arg = &obj;
+
+	obj.timer_ev.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	obj.timer_ev.cb = on_flush_timer;
+	obj.timer_ev.arg = &obj;
+
+	if (obj.signal_ev.fd < 0 || obj.timer_ev.fd < 0) {
+		log_err("(%s): Couldn't create event descriptors: %d (%s)\n",
+			__func__, -errno, strerror(errno));
+		goto done;
+	}
+
+	if (loop_add(&obj.loop, &obj.port_ev) < 0 ||
+		loop_add(&obj.loop, &obj.signal_ev) < 0 ||
+		loop_add(&obj.loop, &obj.timer_ev) < 0)
+		goto done;
+
+	log_msg("Monitoring %s.\n", port);
+	loop_run(&obj.loop);
+
+	busmon_flush(&obj.mon, UINT64_MAX);
+	print_stats(&obj);
+	ret = 1;
+
+done:
+	serial_close_port(&obj.port);
+	if (obj.signal_ev.fd >= 0) close(obj.signal_ev.fd);
+	if (obj.timer_ev.fd >= 0) close(obj.timer_ev.fd);
+	loop_close(&obj.loop);
+
+	return ret;
+}
@@ -0,0 +1,46 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * libnxtp public header
+ *
+ * The library keeps no global state: every call works on the objects
+ * and buffers passed in by the caller, so separate threads can drive
+ * separate ports and signs at the same time. The one exception is the
+ * optional trace, which keeps a ring per thread.
+ */
+
+#ifndef NXTP_H
+#define NXTP_H
+
+#include <stdint.h>
+#include <termios.h>
+
+#include "packet.h"
+#include "charset.h"
+#include "text.h"
+#include "serial.h"
+#include "transport.h"
+#include "budget.h"
+#include "cache.h"
+#include "busmon.h"
+#include "display.h"
+#include "trace.h"
+
+#endif /* NXTP_H */
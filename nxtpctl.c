@@ -20,193 +20,426 @@
 #include "common.h"
 #include "packet.h"
 #include "serial.h"
+#include "charset.h"
 #include "text.h"
+#include "budget.h"
+#include "cache.h"
+#include "loop.h"
+#include "display.h"
+#include "config.h"
+#include "template.h"
+#include "timesrc.h"
+#include "rt.h"
+#include "trace.h"
+#include "signs.h"
+#include "monitor.h"
+#include "discover.h"
 
 #define DEFAULT_PORT	"/dev/ttyUSB0"
 
+#ifndef MAX_ADDRESSES
 #define MAX_ADDRESSES	10
-#define MAX_FORMAT_OPTS	10
+#endif
 
+/* long running controller */
 typedef struct signctl_obj_t {
-	uint8_t address;
-	struct ctlr_cfg_t *ctlr;
-	struct data_buf_t *data;
-	struct serialport_t *port;
-	struct tm countdown_date;
+	struct sign_table_t *signs;
+
+	/* configuration file to watch, if any */
+	char *config_path;
+	char *config_name;
+	struct nxtp_config_t *config;
+
+	/* event sources */
+	struct loop_t loop;
+	struct loop_handler_t signal_ev;
+	struct loop_handler_t timer_ev;
+	struct loop_handler_t flush_ev;
+	struct loop_handler_t inotify_ev;
+
+	/* when the clock timer was due and how late things happened */
+	time_t clock_due;
+	struct jitter_t wake_jitter;
+	struct jitter_t show_jitter;
 } signctl_obj_t;
 
-/* needed to work around implicit declaration */
-extern int nanosleep(const struct timespec *req, struct timespec *rem);
-
-/* nanosecond sleep */
-static void nsleep(unsigned int ns) {
-	struct timespec ts;
-	ts.tv_sec = 0;
-	ts.tv_nsec = ns;
-	nanosleep(&ts, NULL);
-}
-
 static void show_help(char *name) {
 	fprintf(stderr,
 		"Sunrise Systems NXTP Sign Controller v" VERSION "\n"
 		"\n"
 		"Usage: %s -t text [ -p port ] [ -a address ... ]\n"
 		"\t[ -f fmt-name,fmt-value ... ] [ -c mid,extPid,pid ]\n"
+		"\t[ -L line ] [ -P h,v ] [ -S duration [ -T start ] ]\n"
+		"       %s -C config-file [ -S duration [ -T start ] ]\n"
+		"       %s -m [ -p port ]\n"
+		"       %s -D [ -p port ] [ -c mid,extPid,pid ]\n"
 		"\n"
 		"\t-p port\t\t\tUART port to use (default: \"%s\")\n"
 		"\t-a address\t\tAddress of one or more signs\n"
-		"\t-t text\t\t\tText string to use\n"
+		"\t-t text\t\t\tText string to use, may contain {utc},\n"
+		"\t\t\t\t{local:TZ}, {countdown:yyyy/mm/dd hh:mm}\n"
+		"\t\t\t\tand {file:path} fields\n"
 		"\t-f name,value\t\tOne or more format name and value pairs\n"
 		"\t-c mid,extPid,pid\tJ1587 controller configuration\n"
 		"\t-r\t\t\tReset signs before new sending new data\n"
+		"\t-L line\t\t\tOnly update this line of the signs\n"
+		"\t-P h,v\t\t\tOnly update the region starting at this\n"
+		"\t\t\t\tsegment and row\n"
+		"\t-C file\t\t\tRun the signs described in a configuration\n"
+		"\t\t\t\tfile, reloaded on SIGHUP or when it changes\n"
+		"\t-m\t\t\tOnly watch the bus and print every frame\n"
+		"\t\t\t\tand the traffic per MID and PID\n"
+		"\t-D\t\t\tFind the signs on the bus and list them\n"
+		"\t-B percent\t\tShare of the bus left to other J1708\n"
+		"\t\t\t\tnodes (default: %u)\n"
 		"\t-l\t\t\tUTC clock mode\n"
 		"\t-d yyyy/mm/dd hh:mm\tWhen -l is used, count down to given\n"
 		"\t\t\t\tdate in T-ddd:hh:mm:ss format on another\n"
 		"\t\t\t\tsign (address + 1). Upon reaching T, begin\n"
 		"\t\t\t\tcounting up from given date.\n"
+		"\t-S duration\t\tRun on simulated time for this many\n"
+		"\t\t\t\tseconds (or minutes, hours, days with a\n"
+		"\t\t\t\tm, h or d suffix) as fast as possible\n"
+		"\t-T yyyy/mm/dd hh:mm:ss\tLocal time the simulation starts\n"
+		"\t\t\t\tat (default: now)\n"
+		"\t-R prio[,cpu...]\tRun with SCHED_FIFO priority prio\n"
+		"\t\t\t\t(1 to 99) and locked memory, pinned to\n"
+		"\t\t\t\tthe given CPUs\n"
+		"\t-x file\t\t\tRecord every packet sent and received\n"
+		"\t\t\t\tto a binary trace file\n"
+		"\t-X file\t\t\tPrint a trace file as text and exit\n"
 		"\n"
 		"\t-h\t\t\tShow this help and exit\n"
 		"\t-v\t\t\tShow version and exit\n"
+		"\n"
+		"Send SIGUSR1 to print the bus load and clock lateness in clock,\n"
+		"config and monitor mode.\n"
 		"\n",
-	name, DEFAULT_PORT);
+	name, name, name, name, DEFAULT_PORT, DEFAULT_HEADROOM);
 
 	/* warn the user that the OS does not have 64 bit time functions */
 	if (sizeof(time_t) != sizeof(int64_t))
 		fprintf(stderr, "Your system is not Y2038 ready! :(\n");
 }
 
-static uint8_t shutdown;
-
-static void *clock_worker(void *arg) {
-	char text[32];
-	struct tm *utc;
-	time_t now;
-	time_t countdown_secs = 0;
-	time_t time_left = 1;
-	int8_t cur_seconds = -1;
-	char sign;
-	/* countdown */
-	int64_t days;
-	int64_t hours;
-	int64_t minutes;
-	int64_t seconds;
-	char clock_str[] = "^XB2^II%02u:%02u:%02u UTC";
-	char cdown_str[] = "^XB2^IIT-%03hu:%02hhu:%02hhu:%02hhu ";
-
-	struct signctl_obj_t *local_obj = (struct signctl_obj_t *)arg;
-	struct ctlr_cfg_t local_ctlr = *local_obj->ctlr;
-	struct data_buf_t local_data_buf = *local_obj->data;
-	struct serialport_t local_port = *local_obj->port;
-
-	if (local_obj->countdown_date.tm_year) {
-		local_obj->countdown_date.tm_year -= 1900;
-		local_obj->countdown_date.tm_mon -= 1;
-		local_obj->countdown_date.tm_isdst = -1;
-
-		/* get seconds of countdown date */
-		countdown_secs = mktime(&local_obj->countdown_date);
+/*
+ * fire when the text of a sign with template fields changes next, stay
+ * quiet while there are none
+ *
+ * the timer is cancelled when the system clock is set, so it can be
+ * re-armed right away instead of drifting off the second boundary
+ */
+static int8_t arm_clock_timer(struct signctl_obj_t *obj) {
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(struct itimerspec));
+	its.it_value.tv_sec = obj->clock_due = signs_next_render(obj->signs);
+
+	if (timerfd_settime(obj->timer_ev.fd,
+		TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL) < 0) {
+		log_err("(%s): Couldn't arm timer: %d (%s)\n",
+			__func__, -errno, strerror(errno));
+		return -1;
 	}
 
-	while (!shutdown) {
-		/* check time */
-		now = time(NULL);
-		utc = gmtime(&now);
-
-		/* did the seconds change? */
-		if (utc->tm_sec != cur_seconds) {
-			/* no colons on odd seconds */
-			clock_str[11] = clock_str[16] =
-				(utc->tm_sec & 1) ? ' ' : ':';
-
-			/* create the complete time string */
-			sprintf(text, clock_str,
-				utc->tm_hour, utc->tm_min, utc->tm_sec);
-
-			/* send it */
-			make_text(local_ctlr, &local_data_buf,
-				local_obj->address, text);
-			serial_put_buffer(&local_port, local_data_buf);
-
-			if (local_obj->countdown_date.tm_year) {
-				if (now <= countdown_secs) {
-					time_left = countdown_secs - now;
-					sign = '-';
-				} else {
-					time_left = now - countdown_secs;
-					sign = '+';
-				}
+	return 1;
+}
 
-				/* calculate time units */
-				minutes = time_left / 60;
-				seconds = time_left % 60;
-				hours = minutes / 60;
-				minutes	 = minutes % 60;
-				days = hours / 24;
-				hours = hours % 24;
-				/* what if it's a leap year? */
-				days = days % 365;
-
-				cdown_str[8] = sign;
-				cdown_str[14] =
-					cdown_str[21] =
-					cdown_str[28] =
-					(seconds & 1) ? ' ' : ':';
-
-				sprintf(text, cdown_str,
-					(uint16_t)days,
-					(uint8_t)hours,
-					(uint8_t)minutes,
-					(uint8_t)seconds);
-
-				make_text(local_ctlr, &local_data_buf,
-					local_obj->address + 1, text);
-				serial_put_buffer(&local_port, local_data_buf);
-			}
+/*
+ * send queued sign updates, the rest follows once the bus budget has
+ * room again or the next rotating sign is due
+ *
+ */
+static void flush_updates(struct signctl_obj_t *obj) {
+	struct itimerspec its;
+	uint32_t wait = signs_flush(obj->signs, timesrc_wall());
+	uint32_t rotate = signs_next_rotation(obj->signs);
+
+	if (rotate && (!wait || rotate < wait)) wait = rotate;
+
+	memset(&its, 0, sizeof(struct itimerspec));
+	its.it_value.tv_sec = wait / 1000;
+	its.it_value.tv_nsec = (wait % 1000) * 1000000;
+
+	timerfd_settime(obj->flush_ev.fd, 0, &its, NULL);
+
+	/* templates sent just now are rendered again later */
+	arm_clock_timer(obj);
+}
 
-			make_trigger_packet(local_ctlr, &local_data_buf);
-			serial_put_buffer(&local_port, local_data_buf);
-			serial_send(&local_port);
-			reset_data_buf(&local_data_buf);
+static void on_flush_timer(void *arg) {
+	struct signctl_obj_t *obj = (struct signctl_obj_t *)arg;
+	uint64_t expirations;
 
-			/* update seconds counter */
-			cur_seconds = utc->tm_sec;
+	if (read(obj->flush_ev.fd, &expirations, sizeof(uint64_t)) < 0)
+		return;
+
+	flush_updates(obj);
+}
+
+static void on_clock_timer(void *arg) {
+	struct signctl_obj_t *obj = (struct signctl_obj_t *)arg;
+	uint64_t expirations;
+
+	uint8_t sample = 1;
+	uint8_t sent;
+
+	if (read(obj->timer_ev.fd, &expirations, sizeof(uint64_t)) < 0) {
+		if (errno != ECANCELED) return;
+
+		/* the clock was set, lateness means nothing now */
+		sample = 0;
+	}
+
+	if (sample) jitter_add(&obj->wake_jitter, rt_late_us(obj->clock_due));
+
+	/* render everything that is due, even if the clock was set */
+	sent = signs_tick(obj->signs, timesrc_wall());
+
+	/* the triggers are out, the signs show the new text now */
+	if (sample && sent)
+		jitter_add(&obj->show_jitter, rt_late_us(obj->clock_due));
+
+	/* a port lost while ticking is reopened from the flush timer */
+	flush_updates(obj);
+}
+
+/*
+ * load the configuration file again and apply only what changed
+ *
+ */
+static void reload_config(struct signctl_obj_t *obj) {
+	/* a bad edit must not leave half of it in service */
+	static struct nxtp_config_t scratch;
+
+	if (config_load(&scratch, obj->config_path) < 0) {
+		log_err("Keeping the current configuration.\n");
+		return;
+	}
+
+	memcpy(obj->config, &scratch, sizeof(struct nxtp_config_t));
+	signs_apply(obj->signs, obj->config);
+	flush_updates(obj);
+
+	log_msg("Reloaded %s.\n", obj->config_path);
+}
+
+static void print_stats(struct signctl_obj_t *obj) {
+	signs_print_stats(obj->signs);
+	jitter_print(&obj->wake_jitter, "Clock timer lateness");
+	jitter_print(&obj->show_jitter, "Clock update lateness");
+}
+
+static void on_signal(void *arg) {
+	struct signctl_obj_t *obj = (struct signctl_obj_t *)arg;
+	struct signalfd_siginfo info;
+
+	if (read(obj->signal_ev.fd, &info, sizeof(info)) < 0) return;
+
+	switch (info.ssi_signo) {
+		case SIGUSR1:
+			print_stats(obj);
+			break;
+
+		case SIGHUP:
+			reload_config(obj);
+			break;
+
+		default:
+			loop_stop(&obj->loop);
+			break;
+	}
+}
+
+/*
+ * the directory of the configuration file changed
+ *
+ * editors either rewrite the file or rename a new one over it, both
+ * are caught here and a burst of events causes a single reload
+ */
+static void on_inotify(void *arg) {
+	struct signctl_obj_t *obj = (struct signctl_obj_t *)arg;
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *event;
+	uint8_t changed = 0;
+	ssize_t len;
+
+	while ((len = read(obj->inotify_ev.fd, buf, sizeof(buf))) > 0) {
+		for (char *ptr = buf; ptr < buf + len;
+			ptr += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *)ptr;
+			if (event->len &&
+				strcmp(event->name, obj->config_name) == 0)
+				changed = 1;
 		}
+	}
+
+	if (changed) reload_config(obj);
+}
+
+static int8_t watch_config(struct signctl_obj_t *obj) {
+	char dir[PATH_MAX] = {0};
+	char *slash;
 
-		/* wait 1 ms before polling again */
-		nsleep(1000000);
+	strncpy(dir, obj->config_path, PATH_MAX - 1);
+	slash = strrchr(dir, '/');
+	if (slash) {
+		*slash = 0;
+		obj->config_name = obj->config_path + (slash - dir) + 1;
+		if (!dir[0]) strcpy(dir, "/");
+	} else {
+		strcpy(dir, ".");
+		obj->config_name = obj->config_path;
 	}
 
-	/* clear the sign upon shutdown */
-	make_text(local_ctlr, &local_data_buf, local_obj->address, " ");
-	serial_put_buffer(&local_port, local_data_buf);
-	if (local_obj->countdown_date.tm_year) {
-		make_text(local_ctlr, &local_data_buf,
-			local_obj->address + 1, " ");
-		serial_put_buffer(&local_port, local_data_buf);
+	obj->inotify_ev.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	obj->inotify_ev.cb = on_inotify;
+	obj->inotify_ev.arg = obj;
+
+	if (obj->inotify_ev.fd < 0 || inotify_add_watch(obj->inotify_ev.fd,
+		dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		log_err("(%s): Couldn't watch %s: %d (%s)\n",
+			__func__, dir, -errno, strerror(errno));
+		return -1;
 	}
-	make_trigger_packet(local_ctlr, &local_data_buf);
-	serial_put_buffer(&local_port, local_data_buf);
 
-	serial_send(&local_port);
-	reset_data_buf(&local_data_buf);
+	return loop_add(&obj->loop, &obj->inotify_ev);
+}
+
+/*
+ * run the signs on simulated time for the given number of seconds
+ *
+ * Every second a template field changes is rendered and sent, with no
+ * waiting in between. Sent with a file: port, the frames can be
+ * compared against the expected ones afterwards.
+ */
+static int8_t run_simulation(struct signctl_obj_t *obj, uint8_t headroom,
+	time_t start, uint32_t duration) {
+	time_t end = start + duration;
+	time_t next;
+	uint32_t wait;
+	uint64_t real_start;
+	uint64_t real_us;
+
+	real_start = timesrc_system.us();
+	timesrc_simulate(start);
+
+	/* simulated time would go by waiting for a port that isn't there */
+	signs_init(obj->signs, headroom, NULL, -1);
+	if (signs_apply(obj->signs, obj->config) < 0) {
+		signs_close(obj->signs);
+		return -1;
+	}
+	signs_flush_wait(obj->signs, timesrc_wall());
+
+	while (timesrc_wall() < end) {
+		next = signs_next_render(obj->signs);
+		wait = signs_next_rotation(obj->signs);
+		if (!next && !wait) break;
+
+		/* rotations within the current second come first */
+		if (wait && (!next || timesrc_wall() +
+			(time_t)((timesrc_ms() % 1000 + wait) / 1000) < next)) {
+			timesrc_sleep_ms(wait);
+			signs_flush_wait(obj->signs, timesrc_wall());
+			continue;
+		}
+
+		if (next > end) break;
+		timesrc_advance_to(next);
+		signs_tick(obj->signs, timesrc_wall());
+	}
 
-	pthread_exit(NULL);
+	timesrc_advance_to(end);
+	signs_clear_dynamic(obj->signs);
+	signs_print_stats(obj->signs);
+	signs_close(obj->signs);
+
+	real_us = timesrc_system.us() - real_start;
+	log_msg("Simulated %u s in %u.%03u s.\n", duration,
+		(uint32_t)(real_us / 1000000),
+		(uint32_t)(real_us / 1000 % 1000));
+
+	return 1;
 }
 
-static void exit_clock() {
-	shutdown = 1;
+/*
+ * run the signs from an event loop until SIGINT or SIGTERM
+ *
+ */
+static int8_t run_signs(struct signctl_obj_t *obj, uint8_t headroom) {
+	sigset_t sigs;
+	int8_t ret = -1;
+
+	/* signals are delivered through a descriptor instead */
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	sigaddset(&sigs, SIGUSR1);
+	if (obj->config_path) sigaddset(&sigs, SIGHUP);
+	sigprocmask(SIG_BLOCK, &sigs, NULL);
+
+	if (loop_init(&obj->loop) < 0) return -1;
+
+	obj->signal_ev.fd = signalfd(-1, &sigs, SFD_CLOEXEC);
+	obj->signal_ev.cb = on_signal;
+	obj->signal_ev.arg = obj;
+
+	obj->timer_ev.fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+	obj->timer_ev.cb = on_clock_timer;
+	obj->timer_ev.arg = obj;
+
+	obj->flush_ev.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	obj->flush_ev.cb = on_flush_timer;
+	obj->flush_ev.arg = obj;
+
+	obj->inotify_ev.fd = -1;
+
+	if (obj->signal_ev.fd < 0 || obj->timer_ev.fd < 0 ||
+		obj->flush_ev.fd < 0) {
+		log_err("(%s): Couldn't create event descriptors: %d (%s)\n",
+			__func__, -errno, strerror(errno));
+		goto done;
+	}
+
+	if (loop_add(&obj->loop, &obj->signal_ev) < 0 ||
+		loop_add(&obj->loop, &obj->timer_ev) < 0 ||
+		loop_add(&obj->loop, &obj->flush_ev) < 0)
+		goto done;
+
+	/* a missing watch only means changes need a SIGHUP */
+	if (obj->config_path) watch_config(obj);
+
+	/* ports that can't be opened yet are retried from the loop */
+	signs_init(obj->signs, headroom, &obj->loop,
+		obj->flush_ev.fd);
+	signs_apply(obj->signs, obj->config);
+	flush_updates(obj);
+
+	loop_run(&obj->loop);
+
+	signs_clear_dynamic(obj->signs);
+	print_stats(obj);
+	ret = 1;
+
+done:
+	signs_close(obj->signs);
+	if (obj->signal_ev.fd >= 0) close(obj->signal_ev.fd);
+	if (obj->timer_ev.fd >= 0) close(obj->timer_ev.fd);
+	if (obj->flush_ev.fd >= 0) close(obj->flush_ev.fd);
+	if (obj->inotify_ev.fd >= 0) close(obj->inotify_ev.fd);
+	loop_close(&obj->loop);
+
+	return ret;
 }
 
 int main(int argc, char *argv[]) {
 	int opt;
-	char text[MAX_TEXT_LEN + 1] = {0};
+	/* raw UTF-8 input, converted to glyphs by make_text() */
+	char text[MAX_TEXT_LEN * MAX_UTF8_LEN + 1] = {0};
 	char port[PORT_SIZE] = {0};
 
-	/* serial data buffer */
-	struct data_buf_t data_buf;
-
-	struct serialport_t my_port;
-
 	/* sign controller configuration */
 	struct ctlr_cfg_t my_ctlr;
 
@@ -221,15 +454,37 @@ int main(int argc, char *argv[]) {
 	/* reset signs if desired */
 	uint8_t reset = 0;
 
+	/* line or region to update */
+	struct text_pos_t text_pos;
+
 	uint8_t clock_mode = 0;
-	pthread_t clock_thread;
-	pthread_attr_t attr;
-	struct signctl_obj_t clock_obj;
+	struct tm countdown_date;
+
+	/* share of the bus left to other nodes */
+	unsigned long headroom = DEFAULT_HEADROOM;
+
+	/* configuration file */
+	char *config_path = NULL;
+
+	uint8_t monitor_mode = 0;
+	uint8_t discover_mode = 0;
+
+	/* simulated time */
+	uint32_t sim_duration = 0;
+	time_t sim_start = 0;
+	struct tm sim_date;
+	char *unit;
 
-	signal(SIGINT, exit_clock);
-	signal(SIGTERM, exit_clock);
+	/* real-time profile */
+	struct rt_cfg_t rt_cfg;
 
-	const char *short_opt = "p:a:t:f:c:ld:rhv";
+	/* signs and ports as configured and as they are right now */
+	static struct nxtp_config_t config;
+	static struct sign_table_t signs;
+	struct sign_cfg_t *sign;
+	struct signctl_obj_t ctl_obj;
+
+	const char *short_opt = "p:a:t:f:c:ld:rL:P:B:C:mDS:T:R:x:X:hv";
 	const struct option long_opt[] = {
 		{"port",	required_argument,	NULL,	'p'},
 		{"address",	required_argument,	NULL,	'a'},
@@ -239,6 +494,17 @@ int main(int argc, char *argv[]) {
 		{"clock",	no_argument,		NULL,	'l'},
 		{"countdown",	required_argument,	NULL,	'd'},
 		{"reset",	no_argument,		NULL,	'r'},
+		{"line",	required_argument,	NULL,	'L'},
+		{"pos",		required_argument,	NULL,	'P'},
+		{"headroom",	required_argument,	NULL,	'B'},
+		{"config",	required_argument,	NULL,	'C'},
+		{"monitor",	no_argument,		NULL,	'm'},
+		{"discover",	no_argument,		NULL,	'D'},
+		{"simulate",	required_argument,	NULL,	'S'},
+		{"start",	required_argument,	NULL,	'T'},
+		{"realtime",	required_argument,	NULL,	'R'},
+		{"trace",	required_argument,	NULL,	'x'},
+		{"decode",	required_argument,	NULL,	'X'},
 
 		/* preset functions */
 		/* (none) */
@@ -248,10 +514,16 @@ int main(int argc, char *argv[]) {
 		{0,		0,			0,	0}
 	};
 
-	memset(&clock_obj.countdown_date, 0, sizeof(struct tm));
+	memset(&countdown_date, 0, sizeof(struct tm));
+	memset(&ctl_obj, 0, sizeof(struct signctl_obj_t));
+	memset(&rt_cfg, 0, sizeof(struct rt_cfg_t));
+
+	/* a socket port that goes away fails the write instead */
+	signal(SIGPIPE, SIG_IGN);
 
 	/* default sign controller configuration */
-	set_ctlr_config(&my_ctlr, 195, 255, 245);
+	set_ctlr_config(&my_ctlr, DEFAULT_MID, DEFAULT_EXT_PID, DEFAULT_PID);
+	set_text_pos(&text_pos, 1, 1, 1);
 
 keep_parsing_opts:
 
@@ -261,25 +533,25 @@ keep_parsing_opts:
 	switch (opt) {
 		case 'p':
 			strncpy(port, optarg, PORT_SIZE - 1);
-			printf("Using serial port \"%s\".\n", port);
+			log_msg("Using serial port \"%s\".\n", port);
 			break;
 
 		case 'a':
 			if (addr_idx < MAX_ADDRESSES) {
 				address[addr_idx] =
 					strtoul(optarg, NULL, 10);
-				printf("Using sign address %u.\n",
-					address[addr_idx++]);
+				log_msg("Using sign address %u.\n",
+					address[addr_idx]);
+				addr_idx++;
 			} else {
-				fprintf(stderr,
-					"Too many addresses.\n");
+				log_err("Too many addresses.\n");
 				return 1;
 			}
 			break;
 
 		case 't':
-			strncpy(text, optarg, MAX_TEXT_LEN);
-			printf("Using text \"%s\".\n", text);
+			strncpy(text, optarg, sizeof(text) - 1);
+			log_msg("Using text \"%s\".\n", text);
 			break;
 
 		case 'f':
@@ -288,22 +560,22 @@ keep_parsing_opts:
 				if (sscanf(optarg, "%c,%hhu",
 					&fmt[fmt_idx].name,
 					&fmt[fmt_idx].value) == 2) {
-					printf("Using format '%c' = %u.\n",
+					log_msg("Using format '%c' = %u.\n",
 						fmt[fmt_idx].name,
 						fmt[fmt_idx].value);
 					fmt_idx++;
 				} else if (sscanf(optarg, "%c,%c",
 					&fmt[fmt_idx].name,
 					&fmt[fmt_idx].value) == 2) {
-					printf("Using format '%c' = '%c'.\n",
+					log_msg("Using format '%c' = '%c'.\n",
 						fmt[fmt_idx].name,
 						fmt[fmt_idx].value);
 					fmt_idx++;
 				} else {
-					printf("Invalid format syntax.\n");
+					log_msg("Invalid format syntax.\n");
 				}
 			} else {
-				fprintf(stderr, "Too many format options.\n");
+				log_err("Too many format options.\n");
 				return 1;
 			}
 			break;
@@ -314,44 +586,44 @@ keep_parsing_opts:
 				&my_ctlr.mid,
 				&my_ctlr.ext_pid,
 				&my_ctlr.pid) == 3) {
-				printf("Using controller configuration"
+				log_msg("Using controller configuration"
 					" %u/%u/%u.\n",
 					my_ctlr.mid, my_ctlr.ext_pid,
 					my_ctlr.pid);
 			} else {
-				fprintf(stderr,
+				log_err(
 					"Invalid controller config syntax.\n");
 				return 1;
 			}
 			break;
 
 		case 'l':
-			printf("Enabling clock mode.\n");
+			log_msg("Enabling clock mode.\n");
 			clock_mode = 1;
 			break;
 
 		case 'd':
 			if (!addr_idx) {
-				fprintf(stderr, "A sign address is needed for"
+				log_err("A sign address is needed for"
 						" countdown mode.\n");
 				return 1;
 			}
 			if (sscanf(optarg, "%04d/%02d/%02d %02d:%02d",
-				&clock_obj.countdown_date.tm_year,
-				&clock_obj.countdown_date.tm_mon,
-				&clock_obj.countdown_date.tm_mday,
-				&clock_obj.countdown_date.tm_hour,
-				&clock_obj.countdown_date.tm_min
+				&countdown_date.tm_year,
+				&countdown_date.tm_mon,
+				&countdown_date.tm_mday,
+				&countdown_date.tm_hour,
+				&countdown_date.tm_min
 			) == 5) {
-				printf("Countdown date: "
+				log_msg("Countdown date: "
 					"%04d/%02d/%02d %02d:%02d\n",
-					clock_obj.countdown_date.tm_year,
-					clock_obj.countdown_date.tm_mon,
-					clock_obj.countdown_date.tm_mday,
-					clock_obj.countdown_date.tm_hour,
-					clock_obj.countdown_date.tm_min);
+					countdown_date.tm_year,
+					countdown_date.tm_mon,
+					countdown_date.tm_mday,
+					countdown_date.tm_hour,
+					countdown_date.tm_min);
 			} else {
-				fprintf(stderr,
+				log_err(
 					"Invalid date entered.\n");
 				return 1;
 			}
@@ -361,6 +633,102 @@ keep_parsing_opts:
 			reset = 1;
 			break;
 
+		case 'L':
+			text_pos.line = strtoul(optarg, NULL, 10);
+			if (!text_pos.line) {
+				log_err("Lines are counted from 1.\n");
+				return 1;
+			}
+			log_msg("Using line %u.\n", text_pos.line);
+			break;
+
+		case 'P':
+			if (sscanf(optarg, "%hhu,%hhu",
+				&text_pos.h, &text_pos.v) != 2 ||
+				!text_pos.h || text_pos.h > TEXT_POS_MAX ||
+				!text_pos.v || text_pos.v > TEXT_POS_MAX) {
+				log_err("Invalid position, both must be"
+					" 1 to %u.\n", TEXT_POS_MAX);
+				return 1;
+			}
+			log_msg("Using position %u,%u.\n",
+				text_pos.h, text_pos.v);
+			break;
+
+		case 'B':
+			headroom = strtoul(optarg, NULL, 10);
+			if (headroom > 100) {
+				log_err("Headroom must be 0 to 100 percent.\n");
+				return 1;
+			}
+			log_msg("Leaving %lu%% of the bus to other nodes.\n",
+				headroom);
+			break;
+
+		case 'C':
+			config_path = optarg;
+			log_msg("Using configuration file \"%s\".\n",
+				config_path);
+			break;
+
+		case 'm':
+			monitor_mode = 1;
+			break;
+
+		case 'D':
+			discover_mode = 1;
+			break;
+
+		case 'S':
+			sim_duration = strtoul(optarg, &unit, 10);
+			switch (*unit) {
+				case 'd': sim_duration *= 24;	/* fall through */
+				case 'h': sim_duration *= 60;	/* fall through */
+				case 'm': sim_duration *= 60;	/* fall through */
+				case 's':
+				case 0: break;
+				default: sim_duration = 0; break;
+			}
+			if (!sim_duration) {
+				log_err("Invalid simulation duration.\n");
+				return 1;
+			}
+			log_msg("Simulating %u seconds.\n", sim_duration);
+			break;
+
+		case 'T':
+			memset(&sim_date, 0, sizeof(struct tm));
+			if (sscanf(optarg, "%04d/%02d/%02d %02d:%02d:%02d",
+				&sim_date.tm_year, &sim_date.tm_mon,
+				&sim_date.tm_mday, &sim_date.tm_hour,
+				&sim_date.tm_min, &sim_date.tm_sec) < 5) {
+				log_err("Invalid start time entered.\n");
+				return 1;
+			}
+			sim_date.tm_year -= 1900;
+			sim_date.tm_mon -= 1;
+			sim_date.tm_isdst = -1;
+			sim_start = mktime(&sim_date);
+			log_msg("Simulation starts at %s", ctime(&sim_start));
+			break;
+
+		case 'R':
+			if (rt_parse(optarg, &rt_cfg) < 0) {
+				log_err("Invalid real-time profile.\n");
+				return 1;
+			}
+			break;
+
+		case 'x':
+			/* before -R, so the drain thread isn't real-time */
+			if (trace_start(optarg) < 0) return 1;
+			atexit(trace_stop);
+			log_msg("Tracing to \"%s\".\n", optarg);
+			break;
+
+		case 'X':
+			return trace_decode(optarg) < 0;
+
 		case 'v':
 			printf("version " VERSION "\n");
 			return 0;
@@ -375,76 +743,132 @@ keep_parsing_opts:
 
 done_parsing_opts:
 
+	if (sim_duration && !sim_start) sim_start = timesrc_wall();
+
+	if (!port[0] && (monitor_mode || discover_mode))
+		strcpy(port, DEFAULT_PORT);
+
+	/* simulated time has nothing to be late for */
+	if (rt_cfg.prio && !sim_duration && rt_setup(&rt_cfg) < 0) return 1;
+
+	/* the monitor only reads from the bus */
+	if (monitor_mode) {
+		if (run_monitor(port) < 0) return 1;
+
+		return 0;
+	}
+
+	if (discover_mode) {
+		if (run_discovery(port, my_ctlr) < 0) return 1;
+
+		return 0;
+	}
+
+	ctl_obj.signs = &signs;
+	ctl_obj.config = &config;
+
+	if (config_path) {
+		if (config_load(&config, config_path) < 0) return 1;
+
+		if (sim_duration) {
+			if (run_simulation(&ctl_obj, headroom, sim_start,
+				sim_duration) < 0) return 1;
+
+			return 0;
+		}
+
+		ctl_obj.config_path = config_path;
+		if (run_signs(&ctl_obj, headroom) < 0) return 1;
+
+		return 0;
+	}
+
 	if (!text[0] && !clock_mode) {
-		fprintf(stderr, "No text specified.\n\n");
+		log_err("No text specified.\n\n");
 		show_help(argv[0]);
 		return 1;
 	}
 
+	if (template_check(text) < 0) {
+		log_err("Unknown field in text.\n");
+		return 1;
+	}
+
 	if (!port[0]) {
 		strcpy(port, DEFAULT_PORT);
-		printf("Using default port \"%s\".\n", port);
+		log_msg("Using default port \"%s\".\n", port);
 	}
 
 	if (!addr_idx) {
-		printf("Broadcasting to all signs.\n");
+		log_msg("Broadcasting to all signs.\n");
 		addr_idx = 1;
 	}
 
-	/* open the serial port (9600 8n1) */
-	if (serial_open_port(&my_port, port) < 0) return 1;
+	/* describe the signs given on the command line */
+	config_init(&config);
+	config_add_port(&config, "default", port);
 
 	if (clock_mode) {
-		clock_obj.address = address[0];
-		clock_obj.ctlr = &my_ctlr;
-		clock_obj.data = &data_buf;
-		clock_obj.port = &my_port;
-
-		pthread_attr_init(&attr);
-		if (pthread_create(&clock_thread, &attr, clock_worker,
-			(void *)&clock_obj) < 0)
-			fprintf(stderr, "Could not start thread.\n");
-		pthread_attr_destroy(&attr);
-
-		while (1) {
-			sleep(1);
-			if (shutdown) break;
+		sign = config_add_sign(&config, 0, address[0]);
+		sign->ctlr = my_ctlr;
+		strcpy(sign->text, "^XB2^II{utc} UTC");
+
+		/* the countdown goes on the next sign */
+		if (countdown_date.tm_year) {
+			sign = config_add_sign(&config, 0, address[0] + 1);
+			sign->ctlr = my_ctlr;
+			snprintf(sign->text, sizeof(sign->text),
+				"^XB2^II{countdown:%04d/%02d/%02d %02d:%02d} ",
+				countdown_date.tm_year, countdown_date.tm_mon,
+				countdown_date.tm_mday, countdown_date.tm_hour,
+				countdown_date.tm_min);
 		}
 
-		pthread_join(clock_thread, NULL);
-	} else {
-		for (uint8_t i = 0; i < addr_idx; i++) {
-			/* reset the sign */
-			if (reset) {
-				make_reset_packet(my_ctlr, &data_buf,
-					address[i]);
-				serial_put_buffer(&my_port, data_buf);
-				serial_send(&my_port);
-				reset_data_buf(&data_buf);
-			}
+		if (sim_duration) {
+			if (run_simulation(&ctl_obj, headroom, sim_start,
+				sim_duration) < 0) return 1;
 
-			/* send text packets */
-			make_text(my_ctlr, &data_buf,
-				address[i], text);
-			serial_put_buffer(&my_port, data_buf);
+			return 0;
+		}
 
-			/* send optional format packets */
-			for (uint8_t j = 0; j < fmt_idx; j++) {
-				make_format_packet(my_ctlr, &data_buf, fmt[j]);
-				serial_put_buffer(&my_port, data_buf);
-			}
+		if (run_signs(&ctl_obj, headroom) < 0) return 1;
 
-			/* send trigger packet */
-			make_trigger_packet(my_ctlr, &data_buf);
-			serial_put_buffer(&my_port, data_buf);
+		return 0;
+	}
 
-			/* send data out */
-			serial_send(&my_port);
-			reset_data_buf(&data_buf);
-		}
+	for (uint8_t i = 0; i < addr_idx; i++) {
+		sign = config_add_sign(&config, 0, address[i]);
+		sign->ctlr = my_ctlr;
+		sign->pos = text_pos;
+		sign->reset = reset;
+		sign->num_fmts = fmt_idx;
+		memcpy(sign->fmt, fmt, fmt_idx * sizeof(struct text_fmt_t));
+		strcpy(sign->text, text);
+	}
+
+	/* templates keep changing, so there is something to simulate */
+	if (sim_duration) {
+		if (run_simulation(&ctl_obj, headroom, sim_start,
+			sim_duration) < 0) return 1;
+
+		return 0;
 	}
 
-	serial_close_port(&my_port);
+	/* nothing is left running to show the next message */
+	if (config_num_messages(text) > 1) {
+		log_err("Rotating messages need -S or a config file.\n");
+		return 1;
+	}
+
+	/* send everything once */
+	signs_init(&signs, headroom, NULL, -1);
+	if (signs_apply(&signs, &config) < 0) {
+		signs_close(&signs);
+		return 1;
+	}
+	signs_flush_wait(&signs, timesrc_wall());
+	signs_print_stats(&signs);
+	signs_close(&signs);
 
 	return 0;
 }
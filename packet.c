@@ -19,6 +19,7 @@
 
 #include "common.h"
 #include "packet.h"
+#include "trace.h"
 
 /* append the checksum at the end of the packet */
 static void add_checksum(char *pkt, uint8_t pkt_len) {
@@ -32,6 +33,17 @@ static void add_checksum(char *pkt, uint8_t pkt_len) {
 	pkt[pkt_len] = ~csum + 1;
 }
 
+/*
+ * change one byte of a finished packet
+ *
+ * The bytes of a packet sum to 0, so the checksum only has to make up
+ * for the difference instead of being summed up again.
+ */
+void patch_pkt_byte(char *pkt, uint8_t pkt_len, uint8_t offset, char value) {
+	pkt[pkt_len - 1] -= value - pkt[offset];
+	pkt[offset] = value;
+}
+
 void set_ctlr_config(struct ctlr_cfg_t *ctlr_cfg,
 	uint8_t mid, uint8_t ext_pid, uint8_t pid) {
 
@@ -41,16 +53,32 @@ void set_ctlr_config(struct ctlr_cfg_t *ctlr_cfg,
 	ctlr_cfg->pid		= pid;
 }
 
+/* what every sign takes */
+void sign_caps_init(struct sign_caps_t *caps) {
+	caps->seg_len	= MAX_TEXT_SEG_LEN;
+	caps->max_segs	= MAX_TEXT_SEGS;
+}
+
+int8_t check_sign_caps(struct sign_caps_t caps) {
+	if (!caps.seg_len || caps.seg_len > MAX_CAPS_SEG_LEN) return -1;
+	if (!caps.max_segs || caps.max_segs > MAX_TEXT_SEGS) return -1;
+
+	return 1;
+}
+
 /*
  * stuff for constructing compliant J1587 packets
  */
 
+/* returns 0 if the text is too long for any sign */
 uint8_t make_m_pkt(char *buf, struct ctlr_cfg_t ctlr,
 	uint8_t address, uint8_t line_num, uint8_t position, char *text) {
 	struct msg_m_t msg;
-	uint8_t text_len = strlen(text);
+	size_t text_len = strlen(text);
 	uint8_t pkt_len = 0;
 
+	if (text_len > MAX_CAPS_SEG_LEN) return 0;
+
 	/* create the M packet */
 	msg.mid		= ctlr.mid;
 	msg.ext_pid	= ctlr.ext_pid;
@@ -73,9 +101,6 @@ uint8_t make_m_pkt(char *buf, struct ctlr_cfg_t ctlr,
 	add_checksum(buf, pkt_len);
 	pkt_len += 1;
 
-	/* size check */
-	if (pkt_len > MAX_PKT_LEN) pkt_len = MAX_PKT_LEN;
-
 	return pkt_len;
 }
 
@@ -128,7 +153,7 @@ uint8_t make_rp_pkt(char *buf, struct ctlr_cfg_t ctlr) {
 	struct msg_rp_t msg;
 
 	/* create the RP packet */
-	msg.mid		= ctlr.pid;
+	msg.mid		= ctlr.mid;
 	msg.ext_pid	= ctlr.ext_pid;
 	msg.pid		= 384 % 256;	/* 128 */
 	msg.pid2	= 510 % 256;	/* 254 */
@@ -153,46 +178,24 @@ void read_dle_pkt(char *buf, uint8_t len, struct msg_dle_t *msg) {
 		memcpy(msg, buf, MSG_DLE_SIZE);
 	}
 
-#ifdef DEBUG
-	printf("(%s): %u %u %u"
-		" %u %u %u"
-		" '%c' %u %02x %02x %02x '%c' %02x\n",
-		__func__,
-		msg->sign_mid, msg->ext_pid, msg->pid, msg->mid,
-		msg->len,
-		msg->address,
-		msg->state,
-		msg->host_mid,
-		msg->tbmu, msg->tbml, msg->fbm,
-		msg->aux_state,
-		msg->checksum
-	);
-#endif
+	trace(TRACE_DLE, buf, len);
 }
 
 /*
- * reset the data buffer
+ * attach caller-supplied storage to a data buffer
  *
  */
-void reset_data_buf(struct data_buf_t *data_buf) {
-	memset(data_buf->data, 0, BUF_LEN);
-	data_buf->len = 0;
+void init_data_buf(struct data_buf_t *data_buf, char *data, uint16_t size) {
+	data_buf->data = data;
+	data_buf->size = size;
+	reset_data_buf(data_buf);
 }
 
-#ifdef DEBUG
 /*
- * output raw data
+ * reset the data buffer
  *
  */
-void print_bytes(char *msg, uint16_t len) {
-	printf("(%s): length: %u, data:", __func__, len);
-	for (uint16_t i = 0; i < len; i++) {
-		if (msg[i] >= 0x20 && msg[i] <= 0x7e) {
-			printf(" '%c'", msg[i]);
-		} else {
-			printf(" %02x", msg[i]);
-		}
-	}
-	printf("\n");
+void reset_data_buf(struct data_buf_t *data_buf) {
+	memset(data_buf->data, 0, data_buf->size);
+	data_buf->len = 0;
 }
-#endif
@@ -19,7 +19,9 @@
 
 #define MAX_PKT_LEN		21
 #define MAX_TEXT_SEG_LEN	12 /* max text length for a packet */
+#ifndef MAX_TEXT_SEGS
 #define MAX_TEXT_SEGS		15 /* max number of text segments */
+#endif
 #define MAX_TEXT_LEN		(MAX_TEXT_SEG_LEN * MAX_TEXT_SEGS) /* 180 */
 
 /* sign controller configuration */
@@ -32,6 +34,27 @@ typedef struct ctlr_cfg_t {
 extern void set_ctlr_config(struct ctlr_cfg_t *ctlr_cfg,
 	uint8_t mid, uint8_t ext_pid, uint8_t pid);
 
+/*
+ * what the firmware of a sign accepts
+ *
+ * Older signs take 12 glyphs per M packet, which keeps every packet
+ * within MAX_PKT_LEN. Newer firmware takes longer segments, so the same
+ * text goes out in fewer packets with less header and checksum
+ * overhead, and a message holds up to seg_len * max_segs glyphs.
+ */
+typedef struct sign_caps_t {
+	uint8_t seg_len;	/* glyphs per M packet */
+	uint8_t max_segs;	/* M packets per message */
+} sign_caps_t;
+
+#define MAX_CAPS_PKT_LEN	64 /* longest M packet a sign may ask for */
+#define MAX_CAPS_SEG_LEN	(MAX_CAPS_PKT_LEN - MSG_M_SIZE - 1)
+#define CAPS_PKT_LEN(caps)	(MSG_M_SIZE + (caps).seg_len + 1)
+#define MAX_CAPS_TEXT_LEN	(MAX_CAPS_SEG_LEN * MAX_TEXT_SEGS)
+
+extern void sign_caps_init(struct sign_caps_t *caps);
+extern int8_t check_sign_caps(struct sign_caps_t caps);
+
 /*
  * J1587 packet structures
  * (checksum is added later)
@@ -113,8 +136,10 @@ typedef struct msg_dle_t {
 
 #define MSG_DLE_SIZE	sizeof(struct msg_dle_t)
 
+/* caller-supplied data buffer */
 typedef struct data_buf_t {
-	char data[BUF_LEN];
+	char *data;
+	uint16_t size;	/* capacity of data */
 	uint16_t len;
 } data_buf_t;
 
@@ -124,9 +149,8 @@ extern uint8_t make_f_pkt(char *buf, struct ctlr_cfg_t ctlr,
 	uint8_t param, uint8_t value);
 extern uint8_t make_t_pkt(char *buf, struct ctlr_cfg_t ctlr);
 extern uint8_t make_rp_pkt(char *buf, struct ctlr_cfg_t ctlr);
+extern void patch_pkt_byte(char *pkt, uint8_t pkt_len, uint8_t offset,
+	char value);
 extern void read_dle_pkt(char *buf, uint8_t len, struct msg_dle_t *msg);
+extern void init_data_buf(struct data_buf_t *buf, char *data, uint16_t size);
 extern void reset_data_buf(struct data_buf_t *buf);
-
-#ifdef DEBUG
-extern void print_bytes(char *msg, uint16_t len);
-#endif
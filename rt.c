@@ -0,0 +1,173 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * real-time profile
+ *
+ * On busy vehicle computers the event loop can be woken several ms
+ * late, which shows as a clock that stutters. The profile moves the
+ * process to SCHED_FIFO, optionally pins it to some CPUs and locks all
+ * of its memory so page faults can't get in the way either.
+ */
+
+/* CPU affinity is not part of POSIX */
+#define _GNU_SOURCE
+
+#include "common.h"
+#include <sched.h>
+#include <sys/mman.h>
+#include "rt.h"
+
+/*
+ * "prio[,cpu...]"
+ *
+ */
+int8_t rt_parse(char *str, struct rt_cfg_t *cfg) {
+	unsigned long value;
+	char *end;
+
+	memset(cfg, 0, sizeof(struct rt_cfg_t));
+
+	value = strtoul(str, &end, 10);
+	if (end == str || value < 1 || value > 99) return -1;
+	cfg->prio = value;
+
+	while (*end == ',') {
+		if (cfg->num_cpus == RT_MAX_CPUS) return -1;
+
+		str = end + 1;
+		value = strtoul(str, &end, 10);
+		if (end == str || value >= CPU_SETSIZE) return -1;
+		cfg->cpu[cfg->num_cpus++] = value;
+	}
+
+	return *end ? -1 : 1;
+}
+
+/* fault in the stack the loop will ever need */
+static void prefault_stack() {
+	volatile char stack[RT_PREFAULT_STACK];
+
+	for (uint32_t i = 0; i < RT_PREFAULT_STACK; i += 4096)
+		stack[i] = 0;
+
+	/* read back so the array counts as used */
+	(void)stack[0];
+}
+
+int8_t rt_setup(struct rt_cfg_t *cfg) {
+	struct sched_param param;
+	cpu_set_t cpus;
+
+	if (cfg->num_cpus) {
+		CPU_ZERO(&cpus);
+		for (uint8_t i = 0; i < cfg->num_cpus; i++)
+			CPU_SET(cfg->cpu[i], &cpus);
+
+		if (sched_setaffinity(0, sizeof(cpu_set_t), &cpus) < 0) {
+			log_err("(%s): Couldn't pin to CPUs: %d (%s)\n",
+				__func__, -errno, strerror(errno));
+			return -1;
+		}
+	}
+
+	/* everything mapped now is faulted in, later mappings as well */
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		log_err("(%s): Couldn't lock memory: %d (%s)\n",
+			__func__, -errno, strerror(errno));
+		return -1;
+	}
+	prefault_stack();
+
+	memset(&param, 0, sizeof(struct sched_param));
+	param.sched_priority = cfg->prio;
+	if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+		log_err("(%s): Couldn't switch to SCHED_FIFO: %d (%s)\n",
+			__func__, -errno, strerror(errno));
+		return -1;
+	}
+
+	log_msg("Running with SCHED_FIFO priority %u%s.\n", cfg->prio,
+		cfg->num_cpus ? " on the chosen CPUs" : "");
+
+	return 1;
+}
+
+/*
+ * microseconds past the start of a wall clock second
+ *
+ */
+uint32_t rt_late_us(time_t due) {
+	struct timespec ts;
+	int64_t late;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	late = (int64_t)(ts.tv_sec - due) * 1000000 + ts.tv_nsec / 1000;
+	if (late < 0) return 0;
+	if (late > UINT32_MAX) return UINT32_MAX;
+
+	return late;
+}
+
+void jitter_add(struct jitter_t *jitter, uint32_t us) {
+	uint32_t bucket = us / JITTER_BUCKET_US;
+
+	if (bucket >= JITTER_BUCKETS) bucket = JITTER_BUCKETS - 1;
+
+	jitter->hist[bucket]++;
+	jitter->count++;
+	if (us > jitter->max) jitter->max = us;
+}
+
+/*
+ * lateness in us that pct percent of the samples stayed within
+ *
+ */
+uint32_t jitter_percentile(struct jitter_t *jitter, uint8_t pct) {
+	uint64_t want = ((uint64_t)jitter->count * pct + 99) / 100;
+	uint64_t seen = 0;
+	uint32_t us;
+
+	for (uint32_t i = 0; i < JITTER_BUCKETS; i++) {
+		seen += jitter->hist[i];
+		if (seen < want) continue;
+
+		/* the upper end of the bucket, but never past the maximum */
+		us = (i + 1) * JITTER_BUCKET_US;
+		return us < jitter->max ? us : jitter->max;
+	}
+
+	return jitter->max;
+}
+
+void jitter_print(struct jitter_t *jitter, char *what) {
+	uint32_t p50;
+	uint32_t p99;
+
+	if (!jitter->count) return;
+
+	p50 = jitter_percentile(jitter, 50);
+	p99 = jitter_percentile(jitter, 99);
+
+	log_msg("%s: %u.%03u ms p50, %u.%03u ms p99, %u.%03u ms max, "
+		"%u samples.\n", what,
+		p50 / 1000, p50 % 1000, p99 / 1000, p99 % 1000,
+		jitter->max / 1000, jitter->max % 1000, jitter->count);
+}
@@ -0,0 +1,49 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define RT_MAX_CPUS		8
+/* stack touched up front so it never faults while running */
+#define RT_PREFAULT_STACK	(256 * 1024)
+
+/* lateness histogram, anything later lands in the last bucket */
+#define JITTER_BUCKET_US	10
+#ifndef JITTER_BUCKETS
+#define JITTER_BUCKETS		5000	/* 50 ms */
+#endif
+
+/* real-time profile */
+typedef struct rt_cfg_t {
+	uint8_t prio;		/* SCHED_FIFO priority, 0 = off */
+	uint8_t num_cpus;
+	uint16_t cpu[RT_MAX_CPUS];
+} rt_cfg_t;
+
+/* how late something happened compared to when it was due */
+typedef struct jitter_t {
+	uint32_t count;
+	uint32_t max;		/* us */
+	uint32_t hist[JITTER_BUCKETS];
+} jitter_t;
+
+extern int8_t rt_parse(char *str, struct rt_cfg_t *cfg);
+extern int8_t rt_setup(struct rt_cfg_t *cfg);
+extern uint32_t rt_late_us(time_t due);
+extern void jitter_add(struct jitter_t *jitter, uint32_t us);
+extern uint32_t jitter_percentile(struct jitter_t *jitter, uint8_t pct);
+extern void jitter_print(struct jitter_t *jitter, char *what);
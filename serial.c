@@ -18,127 +18,217 @@
  */
 
 /*
- * code for handling serial I/O
- *
- * parts of this code came from
- * https://stackoverflow.com/questions/57152937/canonical-mode-linux-serial-port/57155531#57155531
+ * code for handling serial I/O, the bus is reached through one of the
+ * transports in transport.c
  */
 
 #include "common.h"
 #include "packet.h"
 #include "serial.h"
+#include "transport.h"
+#include "trace.h"
 
-int8_t serial_open_port(struct serialport_t *port_obj, char *port) {
-	struct termios tty;
+int8_t serial_open_port(struct serialport_t *port_obj, char *port,
+	char *buf, uint16_t buf_size) {
+	char *path;
 
 	memset(port_obj, 0, sizeof(struct serialport_t));
 	strncpy(port_obj->port, port, PORT_SIZE - 1);
+	port_obj->buf = buf;
+	port_obj->buf_size = buf_size;
+	port_obj->fd = port_obj->out_fd = -1;
 
-	/* open sesame */
-	port_obj->fd = open(port_obj->port, O_RDWR | O_NOCTTY | O_SYNC);
-	if (port_obj->fd < 0) {
-		fprintf(stderr, "(%s): Error opening %s: %d (%s)\n",
-			__func__, port_obj->port, -errno, strerror(errno));
+	port_obj->transport = transport_find(port_obj->port, &path);
+
+	if (port_obj->transport->open(port_obj, path) < 0) {
+		serial_close_port(port_obj);
 		return -1;
 	}
 
-	memset(&tty, 0, sizeof(struct termios));
+	return 1;
+}
 
-	if (tcgetattr(port_obj->fd, &tty) != 0) {
-		fprintf(stderr, "(%s): Error from tcgetattr: %d (%s)\n",
-			__func__, -errno, strerror(errno));
-		return -1;
-	}
+/*
+ * open the port again after it failed
+ *
+ * USB adapters that come back may get another device name, the stable
+ * /dev/serial/by-id name found when the port was first opened is used
+ * instead then. Device nodes and sockets that are not back yet are
+ * skipped quietly, as this is tried over and over. Transports that
+ * can wait for the other side, like a pty, keep their descriptor.
+ */
+int8_t serial_reopen_port(struct serialport_t *port_obj) {
+	char *path;
 
-	/* set speed to 9600 baud, 8n1 */
-	cfsetospeed(&tty, B9600);
-	cfsetispeed(&tty, B9600);
-
-	tty.c_cflag |= CLOCAL | CREAD;	/* ignore modem controls */
-	tty.c_cflag &= ~CSIZE;
-	tty.c_cflag |= CS8;		/* 8-bit characters */
-	tty.c_cflag &= ~PARENB;		/* no parity bit */
-	tty.c_cflag &= ~CSTOPB;		/* only need 1 stop bit */
-	tty.c_cflag &= ~CRTSCTS;	/* no hardware flow control */
-
-	/* setup for non-canonical mode */
-	tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR);
-	tty.c_iflag &= ~(ICRNL | IXON);
-	tty.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
-	tty.c_oflag &= ~OPOST;
-
-	/* fetch bytes as they become available */
-	tty.c_cc[VMIN] = 1;
-	tty.c_cc[VTIME] = 1;
-
-	if (tcsetattr(port_obj->fd, TCSANOW, &tty) != 0) {
-		fprintf(stderr, "(%s): Error from tcsetattr: %d (%s)\n",
-			__func__, -errno, strerror(errno));
+	serial_reset_buffer(port_obj);
+	transport_find(port_obj->port, &path);
+
+	if (port_obj->transport->reopen)
+		return port_obj->transport->reopen(port_obj, path);
+
+	serial_close_port(port_obj);
+	if (port_obj->stable[0]) path = port_obj->stable;
+
+	if (path[0] == '/' && access(path, F_OK) < 0) return -1;
+
+	if (port_obj->transport->open(port_obj, path) < 0) {
+		serial_close_port(port_obj);
 		return -1;
 	}
 
 	return 1;
 }
 
-void serial_put_buffer(struct serialport_t *port_obj,
+/*
+ * ask the driver to hand over received bytes right away
+ *
+ * USB adapters otherwise hold them back for up to 16 ms, which blurs
+ * the gaps between J1708 frames
+ */
+int8_t serial_set_low_latency(struct serialport_t *port_obj) {
+	struct serial_struct info;
+
+	if (port_obj->fd < 0) return -1;
+	if (ioctl(port_obj->fd, TIOCGSERIAL, &info) < 0) return -1;
+
+	info.flags |= ASYNC_LOW_LATENCY;
+	if (ioctl(port_obj->fd, TIOCSSERIAL, &info) < 0) return -1;
+
+	return 1;
+}
+
+int8_t serial_put_buffer(struct serialport_t *port_obj,
 	struct data_buf_t data_buf) {
 	/* buffer overflow protection */
-	if (data_buf.len > BUF_LEN) return;
+	if (port_obj->buf_len + data_buf.len > port_obj->buf_size) {
+		log_err("(%s): Buffer full!\n", __func__);
+		return -1;
+	}
 	memcpy(port_obj->buf + port_obj->buf_len,
 		data_buf.data, data_buf.len);
 	port_obj->buf_len += data_buf.len;
+
+	return 1;
+}
+
+/*
+ * point a data buffer at the free space left in the port buffer so
+ * packets can be encoded in place without an extra copy
+ *
+ */
+void serial_claim_buffer(struct serialport_t *port_obj,
+	struct data_buf_t *data_buf) {
+	data_buf->data = port_obj->buf + port_obj->buf_len;
+	data_buf->size = port_obj->buf_size - port_obj->buf_len;
+	data_buf->len = 0;
+}
+
+/*
+ * add the packets encoded in place to the port buffer
+ *
+ */
+void serial_commit_buffer(struct serialport_t *port_obj,
+	struct data_buf_t *data_buf) {
+	port_obj->buf_len += data_buf->len;
+	data_buf->size -= data_buf->len;
+	data_buf->data += data_buf->len;
+	data_buf->len = 0;
 }
 
 void serial_get_buffer(struct serialport_t *port_obj,
 	struct data_buf_t *data_buf) {
-	memcpy(data_buf->data, port_obj->buf, port_obj->buf_len);
-	data_buf->len = port_obj->buf_len;
+	uint16_t len = port_obj->buf_len;
+
+	if (len > data_buf->size) len = data_buf->size;
+	memcpy(data_buf->data, port_obj->buf, len);
+	data_buf->len = len;
 }
 
 /*
  * reset the buffer state
  *
  */
-static void serial_reset_buffer(struct serialport_t *port_obj) {
-	memset(port_obj->buf, 0, BUF_LEN);
+void serial_reset_buffer(struct serialport_t *port_obj) {
+	memset(port_obj->buf, 0, port_obj->buf_size);
 	port_obj->buf_len = 0;
 }
 
-int8_t serial_send(struct serialport_t *port_obj) {
-	int16_t ret;
+/*
+ * hand the buffer over to the driver without waiting for it to go out
+ *
+ */
+int8_t serial_write(struct serialport_t *port_obj) {
+	transport_write_t write_fn = port_obj->transport->write;
+	uint16_t sent = 0;
+	int32_t ret;
 
 	/* return when there is nothing to send */
 	if (!port_obj->buf_len) {
-		fprintf(stderr, "(%s): Nothing to send!\n", __func__);
+		log_err("(%s): Nothing to send!\n", __func__);
 		return -1;
 	}
 
-	/* write up to 512 characters */
-	ret = write(port_obj->fd, port_obj->buf, port_obj->buf_len);
-	if (ret < 0) {
-		fprintf(stderr, "(%s): Couldn't send: %d (%s)\n",
-			__func__, -errno, strerror(errno));
-		return -1;
+	/* write out the whole buffer, the driver may take it in parts */
+	while (sent < port_obj->buf_len) {
+		if (write_fn) {
+			ret = write_fn(port_obj, port_obj->buf + sent,
+				port_obj->buf_len - sent);
+		} else {
+			ret = write(port_obj->out_fd, port_obj->buf + sent,
+				port_obj->buf_len - sent);
+		}
+
+		if (ret < 0 && errno == EINTR) continue;
+		if (ret <= 0) {
+			log_err("(%s): Couldn't send: %d (%s)\n",
+				__func__, -errno, strerror(errno));
+			return -1;
+		}
+
+		sent += ret;
 	}
 
-	/* wait for sending to finish */
-	tcdrain(port_obj->fd);
+	trace(TRACE_TX, port_obj->buf, port_obj->buf_len);
+
 	/* reset internal buffer when done */
 	serial_reset_buffer(port_obj);
 
 	return 1;
 }
 
+/*
+ * wait for everything written to leave the port
+ *
+ */
+void serial_drain(struct serialport_t *port_obj) {
+	if (port_obj->transport->drain) port_obj->transport->drain(port_obj);
+}
+
+int8_t serial_send(struct serialport_t *port_obj) {
+	if (serial_write(port_obj) < 0) return -1;
+
+	/* wait for sending to finish */
+	serial_drain(port_obj);
+
+	return 1;
+}
+
 int8_t serial_receive(struct serialport_t *port_obj) {
 	int16_t ret;
 
 	/* prepare internal buffer for new data */
 	serial_reset_buffer(port_obj);
 
-	/* read up to 512 characters */
-	ret = read(port_obj->fd, port_obj->buf, BUF_LEN);
+	if (port_obj->fd < 0) {
+		log_err("(%s): %s can't be read from\n",
+			__func__, port_obj->port);
+		return -1;
+	}
+
+	/* read up to the size of the buffer */
+	ret = read(port_obj->fd, port_obj->buf, port_obj->buf_size);
 	if (ret < 0) {
-		fprintf(stderr, "(%s): Couldn't receive: %d (%s)\n",
+		log_err("(%s): Couldn't receive: %d (%s)\n",
 			__func__, -errno, strerror(errno));
 		return -1;
 	}
@@ -150,12 +240,17 @@ int8_t serial_receive(struct serialport_t *port_obj) {
 }
 
 int8_t serial_close_port(struct serialport_t *port_obj) {
+	int8_t ret = 1;
+
+	if (port_obj->out_fd >= 0 && port_obj->out_fd != port_obj->fd &&
+		close(port_obj->out_fd) < 0) ret = -1;
+	if (port_obj->fd >= 0 && close(port_obj->fd) < 0) ret = -1;
 
-	if (close(port_obj->fd) < 0) {
-		fprintf(stderr, "(%s): Error closing %s: %d (%s)\n",
+	if (ret < 0)
+		log_err("(%s): Error closing %s: %d (%s)\n",
 			__func__, port_obj->port, -errno, strerror(errno));
-		return -1;
-	}
 
-	return 1;
+	port_obj->fd = port_obj->out_fd = -1;
+
+	return ret;
 }
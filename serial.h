@@ -17,13 +17,20 @@
  *
  */
 
-#define PORT_SIZE	32
+#define PORT_SIZE	128 /* room for /dev/serial/by-id paths */
 
-/* serial port object */
+struct transport_t;
+
+/* serial port object (buffer storage is supplied by the caller) */
 typedef struct serialport_t {
 	char port[PORT_SIZE];
-	int fd;
-	char buf[BUF_LEN];
+	/* name that survives the device being plugged in again, if any */
+	char stable[PORT_SIZE];
+	const struct transport_t *transport;
+	int fd;		/* to read from, -1 for write-only transports */
+	int out_fd;	/* to write to */
+	char *buf;
+	uint16_t buf_size;
 	uint16_t buf_len;
 } serialport_t;
 
@@ -32,11 +39,21 @@ typedef struct serialport_t {
 #define CRTSCTS	020000000000 /* flow control */
 #endif
 
-extern int8_t serial_open_port(struct serialport_t *port_obj, char *port);
-extern void serial_put_buffer(struct serialport_t *port_obj,
+extern int8_t serial_open_port(struct serialport_t *port_obj, char *port,
+	char *buf, uint16_t buf_size);
+extern int8_t serial_reopen_port(struct serialport_t *port_obj);
+extern int8_t serial_set_low_latency(struct serialport_t *port_obj);
+extern int8_t serial_put_buffer(struct serialport_t *port_obj,
 	struct data_buf_t data_buf);
+extern void serial_claim_buffer(struct serialport_t *port_obj,
+	struct data_buf_t *data_buf);
+extern void serial_commit_buffer(struct serialport_t *port_obj,
+	struct data_buf_t *data_buf);
 extern void serial_get_buffer(struct serialport_t *port_obj,
 	struct data_buf_t *data_buf);
+extern void serial_reset_buffer(struct serialport_t *port_obj);
+extern int8_t serial_write(struct serialport_t *port_obj);
+extern void serial_drain(struct serialport_t *port_obj);
 extern int8_t serial_send(struct serialport_t *port_obj);
 extern int8_t serial_receive(struct serialport_t *port_obj);
 extern int8_t serial_close_port(struct serialport_t *port_obj);
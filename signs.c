@@ -0,0 +1,917 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * runtime state of the configured ports and signs
+ *
+ * Applying a configuration only touches what changed: ports that keep
+ * their device stay open, signs that keep their settings are left
+ * alone and only new or changed signs get their text sent again.
+ *
+ * Text goes out on every port first and the trigger packets that make
+ * the signs show it are held back until all ports are done, so signs
+ * on different ports flip together.
+ *
+ * Signs with several messages move on to the next one when the display
+ * model says the current one is done, see display.c.
+ */
+
+#include "common.h"
+#include "packet.h"
+#include "serial.h"
+#include "trace.h"
+#include "charset.h"
+#include "text.h"
+#include "budget.h"
+#include "cache.h"
+#include "loop.h"
+#include "display.h"
+#include "config.h"
+#include "template.h"
+#include "timesrc.h"
+#include "signs.h"
+
+static void lose_port(struct port_state_t *port);
+
+/* the text is out, show it with the next release */
+static void hold_trigger(struct port_state_t *port, struct ctlr_cfg_t ctlr) {
+	struct ctlr_cfg_t *held;
+
+	for (uint8_t i = 0; i < port->num_triggers; i++) {
+		held = &port->trigger_ctlr[i];
+		if (held->mid == ctlr.mid && held->ext_pid == ctlr.ext_pid &&
+			held->pid == ctlr.pid) return;
+	}
+
+	if (port->num_triggers == MAX_TRIGGERS) {
+		log_err("Too many controllers on port %s.\n", port->name);
+		return;
+	}
+
+	port->trigger_ctlr[port->num_triggers++] = ctlr;
+}
+
+/*
+ * send the held back triggers of all ports at once
+ *
+ * All text has been drained by now, so the triggers are written back
+ * to back and only need the few ms a trigger takes on the wire. The
+ * skew is the spread between the ports finishing their trigger.
+ */
+static void release_triggers(struct sign_table_t *table) {
+	struct port_state_t *port;
+	struct data_buf_t data_buf;
+	uint64_t ms = timesrc_ms();
+	uint64_t first = 0;
+	uint64_t last = 0;
+	uint64_t done;
+	uint8_t ports = 0;
+	uint8_t p;
+
+	for (p = 0; p < MAX_PORTS; p++) {
+		port = &table->port[p];
+		if (!port->in_use || !port->num_triggers) continue;
+
+		for (uint8_t i = 0; i < port->num_triggers; i++) {
+			serial_claim_buffer(&port->port, &data_buf);
+			make_trigger_packet(port->trigger_ctlr[i], &data_buf);
+			serial_commit_buffer(&port->port, &data_buf);
+		}
+		budget_admit(&port->budget, port->port.buf_len, PRIO_URGENT,
+			ms);
+		if (serial_write(&port->port) < 0) lose_port(port);
+	}
+
+	for (p = 0; p < MAX_PORTS; p++) {
+		port = &table->port[p];
+		if (!port->in_use || !port->num_triggers) continue;
+
+		serial_drain(&port->port);
+		port->num_triggers = 0;
+
+		done = timesrc_us();
+		if (!ports++) first = done;
+		last = done;
+	}
+
+	if (ports < 2) return;
+
+	table->releases++;
+	table->last_skew = last - first;
+	if (table->last_skew > table->max_skew)
+		table->max_skew = table->last_skew;
+}
+
+/*
+ * fill in the fields of a sign's text and note when they change next
+ *
+ */
+static void render_sign(struct sign_state_t *sign, time_t now,
+	char *out, uint8_t *prio) {
+	char msg[sizeof(sign->cfg.text)];
+
+	config_get_message(sign->cfg.text, sign->msg, msg, sizeof(msg));
+	sign->next_render = template_render(msg, now, out,
+		sizeof(sign->cfg.text), prio);
+}
+
+/*
+ * drain whatever the bus sends back so the receive queue never fills up
+ *
+ */
+static void on_port_readable(void *arg) {
+	struct port_state_t *port = (struct port_state_t *)arg;
+
+	/* a read error or a hangup, the port has to be opened again */
+	if (serial_receive(&port->port) < 0 || !port->port.buf_len) {
+		lose_port(port);
+		return;
+	}
+
+	trace(TRACE_RX, port->port.buf, port->port.buf_len);
+
+	serial_reset_buffer(&port->port);
+}
+
+/* write-only transports have nothing to drain */
+static void watch_port(struct port_state_t *port) {
+	struct sign_table_t *table = port->table;
+
+	port->ev.fd = -1;
+	if (!table->loop || port->port.fd < 0) return;
+
+	port->ev.fd = port->port.fd;
+	port->ev.cb = on_port_readable;
+	port->ev.arg = port;
+	loop_add(table->loop, &port->ev);
+}
+
+/*
+ * a port that can't be opened is retried like one that failed later,
+ * so its signs still have somewhere to go
+ */
+static int8_t open_port(struct sign_table_t *table,
+	struct port_state_t *port, struct port_cfg_t *cfg) {
+
+	port->in_use = 1;
+	port->lost = 0;
+	port->num_blanks = 0;
+	strncpy(port->name, cfg->name, NAME_LEN - 1);
+	port->table = table;
+	port->ev.fd = -1;
+	budget_init(&port->budget, BUS_BAUD, table->headroom, timesrc_ms());
+
+	if (serial_open_port(&port->port, cfg->path, port->buf, BUF_LEN) < 0) {
+		lose_port(port);
+		return -1;
+	}
+
+	watch_port(port);
+
+	log_msg("Opened port %s (%s).\n", port->name, port->port.port);
+
+	return 1;
+}
+
+static void close_port(struct sign_table_t *table,
+	struct port_state_t *port) {
+
+	if (table->loop && port->ev.fd >= 0)
+		loop_del(table->loop, &port->ev);
+	serial_close_port(&port->port);
+	port->in_use = 0;
+
+	log_msg("Closed port %s.\n", port->name);
+}
+
+/* append format packets */
+static void make_formats(struct sign_cfg_t *cfg, struct data_buf_t *buf) {
+	struct data_buf_t fmt_buf;
+
+	for (uint8_t i = 0; i < cfg->num_fmts; i++) {
+		fmt_buf.data = buf->data + buf->len;
+		fmt_buf.size = buf->size - buf->len;
+		if (make_format_packet(cfg->ctlr, &fmt_buf, cfg->fmt[i]) < 0)
+			return;
+		buf->len += fmt_buf.len;
+	}
+}
+
+/*
+ * queue an update for a sign
+ *
+ * An update that has not gone out yet is replaced, so only the latest
+ * content of a sign spends time on the wire.
+ */
+static void queue_update(struct sign_table_t *table,
+	struct sign_state_t *sign) {
+	if (sign->pending) table->coalesced++;
+	sign->pending = sign->cfg.reset ? UPDATE_RESET : UPDATE_TEXT;
+	sign->next_render = 0;
+	sign->frame.len = 0;
+	sign->msg = 0;
+	sign->rotate_at = 0;
+	table->queued++;
+}
+
+/*
+ * note when a rotating sign is done with the message just sent
+ *
+ * The next message goes out early by the time it takes to upload, so
+ * it shows right as the current one is done.
+ */
+static void schedule_rotation(struct sign_state_t *sign, char *text) {
+	char glyphs[MAX_CAPS_TEXT_LEN + 1];
+	char next[sizeof(sign->cfg.text)];
+	uint8_t num = config_num_messages(sign->cfg.text);
+	int16_t num_glyphs;
+	uint32_t shown;
+	uint32_t upload;
+
+	if (num < 2) return;
+
+	/* text too long to show was logged when it failed to encode */
+	num_glyphs = utf8_to_glyphs(glyphs, sizeof(glyphs), text);
+	if (num_glyphs < 0) num_glyphs = MAX_CAPS_TEXT_LEN;
+	shown = display_time(&sign->cfg.timing, num_glyphs);
+
+	config_get_message(sign->cfg.text, (sign->msg + 1) % num, next,
+		sizeof(next));
+	num_glyphs = utf8_to_glyphs(glyphs, sizeof(glyphs), next);
+	if (num_glyphs < 0) num_glyphs = MAX_CAPS_TEXT_LEN;
+	upload = display_upload_len(&sign->cfg.caps, num_glyphs);
+	upload = budget_wire_time(&sign->port->budget, upload) / 1000;
+
+	sign->rotate_at = timesrc_ms() + (shown > upload ? shown - upload : 0);
+}
+
+/* move the signs that are done with their message on to the next */
+static void advance_rotations(struct sign_table_t *table, uint64_t ms) {
+	struct sign_state_t *sign;
+
+	for (uint8_t i = 0; i < MAX_SIGNS; i++) {
+		sign = &table->sign[i];
+		if (!sign->in_use || sign->pending || !sign->rotate_at ||
+			sign->rotate_at > ms) continue;
+
+		sign->msg = (sign->msg + 1) %
+			config_num_messages(sign->cfg.text);
+		sign->pending = UPDATE_TEXT;
+		sign->next_render = 0;
+		sign->frame.len = 0;
+		sign->rotate_at = 0;
+		table->rotations++;
+	}
+}
+
+/*
+ * have the flush timer fire within the given milliseconds, unless it
+ * is due sooner already
+ *
+ */
+static void arm_flush(struct sign_table_t *table, uint32_t wait) {
+	struct itimerspec its;
+
+	if (table->flush_fd < 0) return;
+
+	if (timerfd_gettime(table->flush_fd, &its) == 0 &&
+		(its.it_value.tv_sec || its.it_value.tv_nsec) &&
+		its.it_value.tv_sec * 1000 +
+		its.it_value.tv_nsec / 1000000 <= wait) return;
+
+	memset(&its, 0, sizeof(struct itimerspec));
+	its.it_value.tv_sec = wait / 1000;
+	its.it_value.tv_nsec = (wait % 1000) * 1000000;
+
+	timerfd_settime(table->flush_fd, 0, &its, NULL);
+}
+
+/*
+ * the port failed, send everything again once it is back
+ *
+ * The signs may have lost power together with the adapter, so they get
+ * their text and formats again instead of only what changed.
+ */
+static void lose_port(struct port_state_t *port) {
+	struct sign_table_t *table = port->table;
+	struct sign_state_t *sign;
+
+	if (port->lost) return;
+
+	log_err("Lost port %s, reopening it.\n", port->name);
+
+	/* serial_reopen_port() closes it, unless it is kept like a pty */
+	if (table->loop && port->ev.fd >= 0)
+		loop_del(table->loop, &port->ev);
+	port->ev.fd = -1;
+	serial_reset_buffer(&port->port);
+
+	port->lost = 1;
+	port->num_triggers = 0;
+	port->lost_since = timesrc_us();
+	port->backoff = RECOVER_FIRST_MS;
+	port->retry_at = timesrc_ms() + port->backoff;
+	port->attempts = 0;
+
+	/* nothing else may be due to get the port back */
+	arm_flush(table, port->backoff);
+
+	for (uint8_t i = 0; i < MAX_SIGNS; i++) {
+		sign = &table->sign[i];
+		if (!sign->in_use || sign->port != port) continue;
+
+		sign->pending = sign->cfg.reset ? UPDATE_RESET : UPDATE_TEXT;
+		sign->next_render = 0;
+		sign->frame.len = 0;
+		sign->rotate_at = 0;
+	}
+}
+
+/*
+ * try to open a lost port again once its backoff is over
+ *
+ */
+static void recover_port(struct port_state_t *port, uint64_t ms) {
+	struct sign_table_t *table = port->table;
+	uint32_t took;
+
+	if (ms < port->retry_at) return;
+
+	port->attempts++;
+	if (serial_reopen_port(&port->port) < 0) {
+		port->retry_at = ms + port->backoff;
+		port->backoff *= 2;
+		if (port->backoff > RECOVER_MAX_MS)
+			port->backoff = RECOVER_MAX_MS;
+		return;
+	}
+
+	port->lost = 0;
+	watch_port(port);
+
+	took = timesrc_us() - port->lost_since;
+	table->recoveries++;
+	table->last_recovery = took;
+	if (took > table->max_recovery) table->max_recovery = took;
+
+	log_msg("Port %s is back after %u.%03u ms, %u attempts.\n",
+		port->name, took / 1000, took % 1000, port->attempts);
+}
+
+/*
+ * send the next step of a queued update if the bus budget allows it
+ *
+ */
+static int8_t send_update(struct sign_table_t *table,
+	struct sign_state_t *sign, time_t now) {
+	struct port_state_t *port = sign->port;
+	struct sign_cfg_t *cfg = &sign->cfg;
+	struct data_buf_t data_buf;
+	char text[sizeof(cfg->text)];
+	uint8_t prio;
+	int8_t encoded;
+	int8_t ret;
+
+	serial_claim_buffer(&port->port, &data_buf);
+
+	/* the current message of a rotation, or all of the text */
+	config_get_message(cfg->text, sign->msg, text, sizeof(text));
+
+	if (sign->pending == UPDATE_RESET) {
+		encoded = make_reset_packet(cfg->ctlr, cfg->caps, &data_buf,
+			cfg->address);
+	} else if (sign->pending == UPDATE_CLEARED) {
+		/* blank segments need not be sent to a blank sign */
+		if (strchr(text, '{')) render_sign(sign, now, text, &prio);
+		encoded = make_text_sparse(cfg->ctlr, cfg->caps, &data_buf,
+			cfg->address, cfg->pos, text);
+		make_formats(cfg, &data_buf);
+	} else if (!strchr(text, '{')) {
+		encoded = make_text_cached(&table->cache, cfg->ctlr,
+			cfg->caps, &data_buf, cfg->address, cfg->pos, text,
+			cfg->fmt, cfg->num_fmts);
+	} else {
+		render_sign(sign, now, text, &prio);
+		encoded = make_text_frame(&sign->frame, cfg->ctlr, cfg->caps,
+			cfg->address, cfg->pos, text);
+		if (encoded >= 0)
+			encoded = copy_text_frame(&sign->frame, &data_buf);
+		make_formats(cfg, &data_buf);
+	}
+
+	/*
+	 * more text than the sign takes, past its last segment or more
+	 * than the port buffer holds
+	 */
+	if (encoded < 0) {
+		log_err("Sign %u can't show \"%s\".\n", cfg->address, text);
+		sign->pending = 0;
+		return BUDGET_REJECT;
+	}
+
+	/*
+	 * a reset preempts whatever the sign shows, an update that is
+	 * deferred is encoded again next time
+	 */
+	ret = budget_admit(&port->budget, data_buf.len,
+		sign->pending == UPDATE_RESET ? PRIO_URGENT : PRIO_HIGH,
+		timesrc_ms());
+	if (ret == BUDGET_DEFER) return ret;
+
+	if (ret == BUDGET_REJECT) {
+		log_err("Update too large for the bus budget.\n");
+		sign->pending = 0;
+		return ret;
+	}
+
+	serial_commit_buffer(&port->port, &data_buf);
+	if (serial_send(&port->port) < 0) {
+		lose_port(port);
+		return ret;
+	}
+
+	/* the sign wants a moment after a reset, the text comes next */
+	if (sign->pending == UPDATE_RESET) {
+		sign->pending = UPDATE_CLEARED;
+		return ret;
+	}
+
+	sign->pending = 0;
+	hold_trigger(port, cfg->ctlr);
+	if (sign->next_render) strcpy(sign->shown, text);
+	schedule_rotation(sign, text);
+
+	return ret;
+}
+
+/* blank a sign once the bus budget has room for it */
+static void queue_blank(struct sign_state_t *sign) {
+	struct port_state_t *port = sign->port;
+	struct blank_t *blank;
+
+	if (!port || port->num_blanks == MAX_SIGNS) return;
+
+	blank = &port->blank[port->num_blanks++];
+	blank->ctlr = sign->cfg.ctlr;
+	blank->caps = sign->cfg.caps;
+	blank->address = sign->cfg.address;
+	blank->pos = sign->cfg.pos;
+}
+
+/*
+ * send the blanks queued on a port in order, as far as the bus budget
+ * allows
+ *
+ */
+static int8_t send_blanks(struct sign_table_t *table,
+	struct port_state_t *port) {
+	struct data_buf_t data_buf;
+	struct blank_t *blank;
+	int8_t ret;
+
+	while (port->num_blanks && !port->lost) {
+		blank = &port->blank[0];
+
+		serial_claim_buffer(&port->port, &data_buf);
+		ret = make_text_cached(&table->cache, blank->ctlr, blank->caps,
+			&data_buf, blank->address, blank->pos, " ", NULL, 0);
+		if (ret > 0) ret = budget_admit(&port->budget, data_buf.len,
+			PRIO_HIGH, timesrc_ms());
+		if (ret == BUDGET_DEFER) return ret;
+
+		if (ret == BUDGET_ADMIT) {
+			serial_commit_buffer(&port->port, &data_buf);
+			if (serial_send(&port->port) < 0) {
+				/* tried again once the port is back */
+				lose_port(port);
+				return BUDGET_DEFER;
+			}
+			hold_trigger(port, blank->ctlr);
+		}
+
+		port->num_blanks--;
+		memmove(port->blank, port->blank + 1,
+			port->num_blanks * sizeof(struct blank_t));
+	}
+
+	return BUDGET_ADMIT;
+}
+
+void signs_init(struct sign_table_t *table, uint8_t headroom,
+	struct loop_t *loop, int flush_fd) {
+	memset(table, 0, sizeof(struct sign_table_t));
+	table->headroom = headroom;
+	table->loop = loop;
+	table->flush_fd = flush_fd;
+	cache_init(&table->cache);
+}
+
+static int8_t find_cfg_sign(struct nxtp_config_t *cfg,
+	struct sign_state_t *sign) {
+	struct sign_cfg_t *sign_cfg;
+
+	for (uint8_t i = 0; i < cfg->num_signs; i++) {
+		sign_cfg = &cfg->sign[i];
+		if (sign_cfg_same_region(sign_cfg, &sign->cfg) &&
+			strcmp(cfg->port[sign_cfg->port].name,
+				sign->port->name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * bring ports and signs in line with a (new) configuration
+ *
+ * Returns -1 if a port could not be opened. Its signs stay with it
+ * and get their text once it is open.
+ */
+int8_t signs_apply(struct sign_table_t *table,
+	struct nxtp_config_t *cfg) {
+	struct port_state_t *port;
+	struct port_state_t *cfg_port[MAX_PORTS] = {0};
+	uint8_t keep_port[MAX_PORTS] = {0};
+	uint8_t opened[MAX_PORTS] = {0};
+	struct sign_state_t *cfg_sign[MAX_SIGNS] = {0};
+	struct sign_state_t *sign;
+	uint8_t p, i, j;
+	int8_t idx;
+	int8_t ret = 1;
+
+	/* ports that keep their device stay open */
+	for (p = 0; p < MAX_PORTS; p++) {
+		port = &table->port[p];
+		if (!port->in_use) continue;
+		for (i = 0; i < cfg->num_ports; i++) {
+			if (strcmp(cfg->port[i].name, port->name) == 0 &&
+				strcmp(cfg->port[i].path, port->port.port) == 0)
+				keep_port[p] = 1;
+		}
+	}
+
+	/* removed signs are blanked by the next flush */
+	for (i = 0; i < MAX_SIGNS; i++) {
+		sign = &table->sign[i];
+		if (!sign->in_use) continue;
+
+		idx = sign->port ? find_cfg_sign(cfg, sign) : -1;
+		if (idx < 0) {
+			queue_blank(sign);
+			sign->in_use = 0;
+			sign->pending = 0;
+			continue;
+		}
+
+		cfg_sign[idx] = sign;
+	}
+
+	/* ports going away only get the blanks the budget has room for */
+	for (p = 0; p < MAX_PORTS; p++) {
+		if (table->port[p].in_use && !keep_port[p])
+			send_blanks(table, &table->port[p]);
+	}
+	release_triggers(table);
+
+	for (p = 0; p < MAX_PORTS; p++) {
+		if (table->port[p].in_use && !keep_port[p])
+			close_port(table, &table->port[p]);
+	}
+
+	/* open ports that are new or changed their device */
+	for (i = 0; i < cfg->num_ports; i++) {
+		cfg_port[i] = NULL;
+
+		for (p = 0; p < MAX_PORTS; p++) {
+			port = &table->port[p];
+			if (port->in_use &&
+				strcmp(port->name, cfg->port[i].name) == 0)
+				cfg_port[i] = port;
+		}
+		if (cfg_port[i]) continue;
+
+		for (p = 0; p < MAX_PORTS; p++) {
+			if (table->port[p].in_use) continue;
+			if (open_port(table, &table->port[p],
+				&cfg->port[i]) < 0) ret = -1;
+			cfg_port[i] = &table->port[p];
+			opened[p] = 1;
+			break;
+		}
+	}
+
+	/* send whatever is new or changed */
+	for (j = 0; j < cfg->num_signs; j++) {
+		port = cfg_port[cfg->sign[j].port];
+		sign = cfg_sign[j];
+
+		if (sign && sign->port == port &&
+			!opened[port - table->port] &&
+			sign_cfg_equal(&sign->cfg, &cfg->sign[j])) {
+			/* the port may have moved in the list */
+			sign->cfg.port = cfg->sign[j].port;
+			continue;
+		}
+
+		if (!sign) {
+			for (i = 0; i < MAX_SIGNS; i++) {
+				if (!table->sign[i].in_use) break;
+			}
+			sign = &table->sign[i];
+		}
+
+		sign->in_use = 1;
+		sign->cfg = cfg->sign[j];
+		sign->port = port;
+		queue_update(table, sign);
+	}
+
+	return ret;
+}
+
+/*
+ * send queued updates as far as the bus budget allows
+ *
+ * Returns the milliseconds after which the rest can go out, or 0 once
+ * the queue is empty.
+ */
+uint32_t signs_flush(struct sign_table_t *table, time_t now) {
+	struct port_state_t *port;
+	struct sign_state_t *sign;
+	uint64_t ms = timesrc_ms();
+	uint32_t wait = 0;
+	uint32_t port_wait;
+	uint8_t deferred;
+	uint8_t p;
+
+	advance_rotations(table, ms);
+
+	for (p = 0; p < MAX_PORTS; p++) {
+		port = &table->port[p];
+		if (!port->in_use) continue;
+
+		if (port->lost) recover_port(port, ms);
+
+		deferred = send_blanks(table, port) == BUDGET_DEFER;
+		for (uint8_t i = 0; i < MAX_SIGNS && !deferred; i++) {
+			sign = &table->sign[i];
+			if (!sign->in_use || sign->port != port) continue;
+
+			while (sign->pending && !deferred && !port->lost) {
+				deferred = send_update(table, sign, now) ==
+					BUDGET_DEFER;
+			}
+		}
+
+		/* keep the order of updates on this port */
+		if (!deferred || port->lost) continue;
+
+		port_wait = budget_wait(&port->budget, timesrc_ms());
+		if (!port_wait) port_wait = 1;
+		if (!wait || port_wait < wait) wait = port_wait;
+	}
+
+	release_triggers(table);
+
+	/* ports lost along the way included */
+	for (p = 0; p < MAX_PORTS; p++) {
+		port = &table->port[p];
+		if (!port->in_use || !port->lost) continue;
+
+		port_wait = port->retry_at > ms ? port->retry_at - ms : 1;
+		if (!wait || port_wait < wait) wait = port_wait;
+	}
+
+	return wait;
+}
+
+/*
+ * send all queued updates, waiting for the bus budget where needed
+ *
+ */
+void signs_flush_wait(struct sign_table_t *table, time_t now) {
+	uint32_t wait;
+
+	while ((wait = signs_flush(table, now))) timesrc_sleep_ms(wait);
+}
+
+/*
+ * when does the text of a sign change next? (0 if never)
+ *
+ */
+time_t signs_next_render(struct sign_table_t *table) {
+	struct sign_state_t *sign;
+	time_t next = 0;
+
+	for (uint8_t i = 0; i < MAX_SIGNS; i++) {
+		sign = &table->sign[i];
+
+		/* queued signs are rendered when they go out */
+		if (!sign->in_use || sign->pending || !sign->next_render)
+			continue;
+		if (!next || sign->next_render < next)
+			next = sign->next_render;
+	}
+
+	return next;
+}
+
+/*
+ * milliseconds until the next rotating sign moves on (0 if none does)
+ *
+ */
+uint32_t signs_next_rotation(struct sign_table_t *table) {
+	struct sign_state_t *sign;
+	uint64_t ms = timesrc_ms();
+	uint64_t next = 0;
+
+	for (uint8_t i = 0; i < MAX_SIGNS; i++) {
+		sign = &table->sign[i];
+		if (!sign->in_use || sign->pending || !sign->rotate_at)
+			continue;
+		if (!next || sign->rotate_at < next)
+			next = sign->rotate_at;
+	}
+
+	if (!next) return 0;
+
+	return next > ms ? next - ms : 1;
+}
+
+/*
+ * render the signs whose fields are due and send those that changed
+ *
+ * Returns the number of signs sent.
+ */
+uint8_t signs_tick(struct sign_table_t *table, time_t now) {
+	struct port_state_t *port;
+	struct sign_state_t *sign;
+	struct data_buf_t data_buf;
+	uint64_t ms = timesrc_ms();
+	char text[sizeof(sign->cfg.text)];
+	uint8_t prio;
+	uint8_t sent = 0;
+
+	for (uint8_t p = 0; p < MAX_PORTS; p++) {
+		port = &table->port[p];
+		if (!port->in_use || port->lost) continue;
+
+		/*
+		 * encode straight into the port buffer, updates are only
+		 * committed if the bus budget has room for them
+		 */
+		serial_claim_buffer(&port->port, &data_buf);
+
+		for (uint8_t i = 0; i < MAX_SIGNS; i++) {
+			sign = &table->sign[i];
+			if (!sign->in_use || sign->port != port ||
+				sign->pending || !sign->next_render ||
+				sign->next_render > now) continue;
+
+			render_sign(sign, now, text, &prio);
+			if (strcmp(text, sign->shown) == 0) continue;
+
+			/* the layout of most templates never changes */
+			if (patch_text_frame(&sign->frame, text) >= 0) {
+				table->patched++;
+			} else if (make_text_frame(&sign->frame,
+				sign->cfg.ctlr, sign->cfg.caps,
+				sign->cfg.address, sign->cfg.pos, text) >= 0) {
+				table->encoded++;
+			} else {
+				/* not again until the text changes */
+				log_err("Sign %u can't show \"%s\".\n",
+					sign->cfg.address, text);
+				strcpy(sign->shown, text);
+				continue;
+			}
+
+			/* the port buffer is full for this second */
+			if (copy_text_frame(&sign->frame, &data_buf) < 0) {
+				sign->next_render = now + 1;
+				continue;
+			}
+
+			if (budget_admit(&port->budget, data_buf.len,
+				prio, ms) == BUDGET_ADMIT) {
+				serial_commit_buffer(&port->port, &data_buf);
+				hold_trigger(port, sign->cfg.ctlr);
+				strcpy(sign->shown, text);
+				sent++;
+			} else {
+				/* try again in a second */
+				sign->next_render = now + 1;
+			}
+		}
+
+		/* nothing fit this second */
+		if (!port->port.buf_len) continue;
+
+		if (serial_send(&port->port) < 0) lose_port(port);
+	}
+
+	release_triggers(table);
+
+	return sent;
+}
+
+/*
+ * clear the signs showing templates upon shutdown, as they would go
+ * stale
+ *
+ */
+void signs_clear_dynamic(struct sign_table_t *table) {
+	struct port_state_t *port;
+
+	for (uint8_t i = 0; i < MAX_SIGNS; i++) {
+		if (table->sign[i].in_use &&
+			template_has_fields(table->sign[i].cfg.text))
+			queue_blank(&table->sign[i]);
+	}
+
+	/* nothing else runs any more, so wait for the bus budget here */
+	for (uint8_t p = 0; p < MAX_PORTS; p++) {
+		port = &table->port[p];
+		if (!port->in_use) continue;
+
+		while (send_blanks(table, port) == BUDGET_DEFER &&
+			!port->lost) {
+			timesrc_sleep_ms(budget_wait(&port->budget,
+				timesrc_ms()));
+		}
+	}
+	release_triggers(table);
+}
+
+void signs_close(struct sign_table_t *table) {
+	for (uint8_t p = 0; p < MAX_PORTS; p++) {
+		if (table->port[p].in_use)
+			close_port(table, &table->port[p]);
+	}
+}
+
+void signs_print_stats(struct sign_table_t *table) {
+	struct bus_budget_t *budget;
+	uint16_t load;
+	uint16_t peak;
+
+	for (uint8_t p = 0; p < MAX_PORTS; p++) {
+		if (!table->port[p].in_use) continue;
+
+		budget = &table->port[p].budget;
+		load = budget_load(budget, timesrc_ms());
+		peak = budget_peak_load(budget);
+
+		log_msg("Bus load on %s: %u.%u%% average, %u.%u%% peak,"
+			" %u admitted, %u deferred, %u rejected.\n",
+			table->port[p].name,
+			load / 10, load % 10, peak / 10, peak % 10,
+			budget->admitted, budget->deferred, budget->rejected);
+	}
+
+	log_msg("Updates: %u queued, %u coalesced.\n",
+		table->queued, table->coalesced);
+
+	if (table->releases)
+		log_msg("Trigger skew across ports: %u.%03u ms last, "
+			"%u.%03u ms max, %u releases.\n",
+			table->last_skew / 1000, table->last_skew % 1000,
+			table->max_skew / 1000, table->max_skew % 1000,
+			table->releases);
+
+	log_msg("Encode cache: %u hits, %u misses.\n",
+		table->cache.hits, table->cache.misses);
+
+	if (table->rotations)
+		log_msg("Rotations: %u messages sent on schedule.\n",
+			table->rotations);
+
+	if (table->recoveries)
+		log_msg("Port recovery: %u.%03u ms last, %u.%03u ms max, "
+			"%u recoveries.\n",
+			table->last_recovery / 1000,
+			table->last_recovery % 1000,
+			table->max_recovery / 1000,
+			table->max_recovery % 1000,
+			table->recoveries);
+
+	if (table->patched || table->encoded)
+		log_msg("Template frames: %u patched, %u encoded.\n",
+			table->patched, table->encoded);
+}
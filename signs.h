@@ -0,0 +1,122 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+struct sign_table_t;
+
+/* reopening a failed port, the wait doubles after every attempt */
+#ifndef RECOVER_FIRST_MS
+#define RECOVER_FIRST_MS	20
+#endif
+#ifndef RECOVER_MAX_MS
+#define RECOVER_MAX_MS		250
+#endif
+
+/* distinct controller settings a port may hold triggers for */
+#define MAX_TRIGGERS		(MAX_CTLRS + 1)	/* ctlr entries and the default */
+
+/* where a removed sign showed its text, to be blanked */
+typedef struct blank_t {
+	struct ctlr_cfg_t ctlr;
+	struct sign_caps_t caps;
+	uint8_t address;
+	struct text_pos_t pos;
+} blank_t;
+
+/* runtime state of a serial port */
+typedef struct port_state_t {
+	uint8_t in_use;
+	char name[NAME_LEN];
+	struct serialport_t port;
+	char buf[BUF_LEN];
+	struct bus_budget_t budget;
+	struct loop_handler_t ev;
+	struct sign_table_t *table;
+	/* text is uploaded, one trigger per controller is held back */
+	uint8_t num_triggers;
+	struct ctlr_cfg_t trigger_ctlr[MAX_TRIGGERS];
+	/* removed signs, blanked before any other update goes out */
+	uint8_t num_blanks;
+	struct blank_t blank[MAX_SIGNS];
+	/* a write failed, the port is reopened with backoff */
+	uint8_t lost;
+	uint64_t lost_since;	/* us */
+	uint64_t retry_at;	/* ms */
+	uint32_t backoff;	/* ms */
+	uint32_t attempts;
+} port_state_t;
+
+/* queued update of a sign */
+#define UPDATE_TEXT	1
+#define UPDATE_RESET	2	/* reset first, then the text */
+#define UPDATE_CLEARED	3	/* the text, on a sign just reset */
+
+/* runtime state of a sign */
+typedef struct sign_state_t {
+	uint8_t in_use;
+	struct sign_cfg_t cfg;
+	struct port_state_t *port;
+	uint8_t pending;
+	/* templates: when to render again and what the sign shows */
+	time_t next_render;
+	char shown[MAX_TEXT_LEN * MAX_UTF8_LEN + 1];
+	/* the packets last rendered, patched on the next tick */
+	struct text_frame_t frame;
+	/* rotation: message shown and when to send the next one (ms) */
+	uint8_t msg;
+	uint64_t rotate_at;
+} sign_state_t;
+
+typedef struct sign_table_t {
+	struct port_state_t port[MAX_PORTS];
+	struct sign_state_t sign[MAX_SIGNS];
+	uint8_t headroom;
+	struct text_cache_t cache;
+	/* updates queued and replaced by newer ones before going out */
+	uint32_t queued;
+	uint32_t coalesced;
+	/* spread of the triggers released on several ports at once */
+	uint32_t releases;
+	uint32_t last_skew;
+	uint32_t max_skew;
+	/* template ticks patched in place or encoded again */
+	uint32_t patched;
+	uint32_t encoded;
+	/* messages of rotating signs sent on schedule */
+	uint32_t rotations;
+	/* time from losing a port to having it open again, in us */
+	uint32_t recoveries;
+	uint32_t last_recovery;
+	uint32_t max_recovery;
+	/* set when running in an event loop */
+	struct loop_t *loop;
+	int flush_fd;	/* timer that calls signs_flush(), -1 if none */
+} sign_table_t;
+
+extern void signs_init(struct sign_table_t *table, uint8_t headroom,
+	struct loop_t *loop, int flush_fd);
+extern int8_t signs_apply(struct sign_table_t *table,
+	struct nxtp_config_t *cfg);
+extern uint32_t signs_flush(struct sign_table_t *table, time_t now);
+extern void signs_flush_wait(struct sign_table_t *table, time_t now);
+extern time_t signs_next_render(struct sign_table_t *table);
+extern uint32_t signs_next_rotation(struct sign_table_t *table);
+extern uint8_t signs_tick(struct sign_table_t *table, time_t now);
+extern void signs_clear_dynamic(struct sign_table_t *table);
+extern void signs_close(struct sign_table_t *table);
+extern void signs_print_stats(struct sign_table_t *table);
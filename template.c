@@ -0,0 +1,451 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * sign text templates
+ *
+ * Text may contain fields that are filled in when the sign is updated:
+ *
+ *   {utc}			UTC time, hh:mm:ss with blinking colons
+ *   {local:<TZ>}		local time in a time zone, hh:mm
+ *   {countdown:<date>}		T-ddd:hh:mm:ss to (and after) a local
+ *				date given as yyyy/mm/dd hh:mm
+ *   {file:<path>}		first line of a file
+ *
+ * "{{" stands for a literal brace. Every field tells when it changes
+ * next, so a sign is only rendered again at that time and only sent
+ * when the result differs from what it shows.
+ *
+ * The UTC offset of a time zone is looked up when the template is
+ * checked and again only when it changes, as switching TZ changes the
+ * whole process. Files are only read again when they were modified.
+ */
+
+#include "common.h"
+#include "budget.h"
+#include "template.h"
+
+typedef time_t (*field_render_t)(char *arg, time_t now, char *out);
+
+typedef struct field_t {
+	char *name;
+	uint8_t has_arg;
+	uint8_t prio;		/* bus priority of signs showing it */
+	field_render_t render;
+} field_t;
+
+/* UTC offset of a time zone and when it holds */
+typedef struct zone_t {
+	char name[TEMPLATE_FIELD_LEN];
+	time_t from;
+	time_t until;		/* next change, like the end of DST */
+	long offset;		/* seconds east of UTC */
+} zone_t;
+
+/* first line of a file as of its last modification */
+typedef struct file_t {
+	char path[TEMPLATE_FIELD_LEN];
+	struct timespec mtime;
+	off_t size;
+	char line[TEMPLATE_FIELD_LEN];
+} file_t;
+
+/* date a countdown runs to, in local time */
+typedef struct date_t {
+	char arg[TEMPLATE_FIELD_LEN];
+	time_t when;
+} date_t;
+
+static struct zone_t zones[TEMPLATE_ZONES];
+static uint8_t next_zone;
+static struct file_t files[TEMPLATE_FILES];
+static uint8_t next_file;
+static struct date_t dates[TEMPLATE_DATES];
+static uint8_t next_date;
+
+/* write a zero-padded decimal number without pulling in sprintf */
+static void put_digits(char *str, uint16_t value, uint8_t width) {
+	while (width--) {
+		str[width] = '0' + value % 10;
+		value /= 10;
+	}
+}
+
+static time_t render_utc(char *arg, time_t now, char *out) {
+	struct tm utc;
+
+	(void)arg;
+	gmtime_r(&now, &utc);
+
+	strcpy(out, "00:00:00");
+	put_digits(out, utc.tm_hour, 2);
+	put_digits(out + 3, utc.tm_min, 2);
+	put_digits(out + 6, utc.tm_sec, 2);
+
+	/* no colons on odd seconds */
+	if (utc.tm_sec & 1) out[2] = out[5] = ' ';
+
+	return now + 1;
+}
+
+/* seconds since the epoch of a broken down time taken as UTC */
+static time_t tm_to_utc(struct tm *tm) {
+	int64_t y = tm->tm_year + 1900 - (tm->tm_mon < 2);
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	int64_t yoe = y - era * 400;
+	int64_t doy = (153 * (tm->tm_mon + (tm->tm_mon < 2 ? 10 : -2)) + 2) /
+		5 + tm->tm_mday - 1;
+	int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	int64_t days = era * 146097 + doe - 719468;
+
+	return days * 86400 + tm->tm_hour * 3600 + tm->tm_min * 60 +
+		tm->tm_sec;
+}
+
+/* with TZ set to the zone */
+static long get_offset(time_t t) {
+	struct tm local;
+
+	localtime_r(&t, &local);
+
+	return tm_to_utc(&local) - t;
+}
+
+/*
+ * look up the offset of a zone at now and find when it changes next
+ *
+ * Only done when a template is checked and when the offset changes,
+ * the process time zone is back to what it was afterwards.
+ */
+static void resolve_zone(struct zone_t *zone, time_t now) {
+	char saved[64] = {0};
+	char *tz = getenv("TZ");
+	time_t lo;
+	time_t hi;
+	time_t mid;
+
+	if (tz) strncpy(saved, tz, sizeof(saved) - 1);
+
+	setenv("TZ", zone->name, 1);
+	tzset();
+
+	zone->offset = get_offset(now);
+	zone->from = now;
+
+	/* zones change at most a few times a year, check once a day */
+	for (hi = now + 86400; hi < now + 366 * 86400; hi += 86400) {
+		if (get_offset(hi) != zone->offset) break;
+	}
+
+	/* and narrow it down to the second */
+	lo = hi - 86400;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (get_offset(mid) == zone->offset) lo = mid; else hi = mid;
+	}
+	zone->until = hi;
+
+	if (tz) setenv("TZ", saved, 1); else unsetenv("TZ");
+	tzset();
+}
+
+static struct zone_t *get_zone(char *name, time_t now) {
+	struct zone_t *zone = NULL;
+
+	for (uint8_t i = 0; i < TEMPLATE_ZONES; i++) {
+		if (strcmp(zones[i].name, name) == 0) zone = &zones[i];
+	}
+
+	if (!zone) {
+		/* take turns when there are more zones than slots */
+		zone = &zones[next_zone];
+		next_zone = (next_zone + 1) % TEMPLATE_ZONES;
+		strcpy(zone->name, name);
+		zone->until = 0;
+	}
+
+	if (now < zone->from || now >= zone->until) resolve_zone(zone, now);
+
+	return zone;
+}
+
+static time_t render_local(char *arg, time_t now, char *out) {
+	struct zone_t *zone = get_zone(arg, now);
+	time_t local_time = now + zone->offset;
+	time_t next;
+	struct tm local;
+
+	gmtime_r(&local_time, &local);
+
+	strcpy(out, "00:00");
+	put_digits(out, local.tm_hour, 2);
+	put_digits(out + 3, local.tm_min, 2);
+
+	/* next minute, or when the offset changes */
+	next = now - local.tm_sec + 60;
+
+	return next < zone->until ? next : zone->until;
+}
+
+static time_t get_date(char *arg) {
+	struct date_t *date;
+	struct tm tm;
+
+	for (uint8_t i = 0; i < TEMPLATE_DATES; i++) {
+		if (strcmp(dates[i].arg, arg) == 0) return dates[i].when;
+	}
+
+	/* take turns when there are more countdowns than slots */
+	date = &dates[next_date];
+	next_date = (next_date + 1) % TEMPLATE_DATES;
+	strcpy(date->arg, arg);
+
+	memset(&tm, 0, sizeof(struct tm));
+	sscanf(arg, "%d/%d/%d %d:%d", &tm.tm_year, &tm.tm_mon,
+		&tm.tm_mday, &tm.tm_hour, &tm.tm_min);
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	tm.tm_isdst = -1;
+	date->when = mktime(&tm);
+
+	return date->when;
+}
+
+static time_t render_countdown(char *arg, time_t now, char *out) {
+	time_t when = get_date(arg);
+	time_t time_left;
+	/* countdown */
+	int64_t days;
+	int64_t hours;
+	int64_t minutes;
+	int64_t seconds;
+
+	strcpy(out, "T-000:00:00:00");
+	if (now <= when) {
+		time_left = when - now;
+	} else {
+		time_left = now - when;
+		out[1] = '+';
+	}
+
+	/* calculate time units */
+	minutes = time_left / 60;
+	seconds = time_left % 60;
+	hours = minutes / 60;
+	minutes = minutes % 60;
+	days = hours / 24;
+	hours = hours % 24;
+	/* what if it's a leap year? */
+	days = days % 365;
+
+	put_digits(out + 2, days, 3);
+	put_digits(out + 6, hours, 2);
+	put_digits(out + 9, minutes, 2);
+	put_digits(out + 12, seconds, 2);
+
+	/* no colons on odd seconds */
+	if (seconds & 1) out[5] = out[8] = out[11] = ' ';
+
+	return now + 1;
+}
+
+static struct file_t *get_file(char *path) {
+	struct file_t *file;
+
+	for (uint8_t i = 0; i < TEMPLATE_FILES; i++) {
+		if (strcmp(files[i].path, path) == 0) return &files[i];
+	}
+
+	/* take turns when there are more files than slots */
+	file = &files[next_file];
+	next_file = (next_file + 1) % TEMPLATE_FILES;
+	memset(file, 0, sizeof(struct file_t));
+	strcpy(file->path, path);
+	file->size = -1;
+
+	return file;
+}
+
+static time_t render_file(char *arg, time_t now, char *out) {
+	struct file_t *file = get_file(arg);
+	struct stat st;
+	FILE *f;
+
+	if (stat(arg, &st) < 0) {
+		file->size = -1;
+		file->line[0] = 0;
+	} else if (st.st_mtim.tv_sec != file->mtime.tv_sec ||
+		st.st_mtim.tv_nsec != file->mtime.tv_nsec ||
+		st.st_size != file->size) {
+		/* changed since it was last read */
+		file->mtime = st.st_mtim;
+		file->size = st.st_size;
+		file->line[0] = 0;
+
+		f = fopen(arg, "r");
+		if (f) {
+			if (fgets(file->line, TEMPLATE_FIELD_LEN, f))
+				file->line[strcspn(file->line, "\r\n")] = 0;
+			fclose(f);
+		}
+	}
+
+	strcpy(out, file->line);
+
+	return now + TEMPLATE_FILE_POLL;
+}
+
+static const struct field_t fields[] = {
+	{"utc",		0,	PRIO_HIGH,	render_utc},
+	{"local",	1,	PRIO_HIGH,	render_local},
+	/* countdowns are the first to give way on a busy bus */
+	{"countdown",	1,	PRIO_LOW,	render_countdown},
+	{"file",	1,	PRIO_LOW,	render_file},
+};
+
+#define NUM_FIELDS	(sizeof(fields) / sizeof(fields[0]))
+
+/*
+ * split "{name:arg}" at tpl, returns the length up to the closing
+ * brace or -1 if it is not a known field
+ */
+static int16_t parse_field(char *tpl, const struct field_t **field,
+	char *arg) {
+	char *end = strchr(tpl, '}');
+	char *colon;
+	uint16_t name_len;
+
+	if (!end) return -1;
+
+	colon = memchr(tpl, ':', end - tpl);
+	name_len = (colon ? colon : end) - tpl - 1;
+
+	arg[0] = 0;
+	if (colon) {
+		if (end - colon - 1 >= TEMPLATE_FIELD_LEN) return -1;
+		memcpy(arg, colon + 1, end - colon - 1);
+		arg[end - colon - 1] = 0;
+	}
+
+	for (uint8_t i = 0; i < NUM_FIELDS; i++) {
+		if (strlen(fields[i].name) != name_len ||
+			strncmp(fields[i].name, tpl + 1, name_len) != 0)
+			continue;
+		if (fields[i].has_arg != (colon != NULL)) return -1;
+		*field = &fields[i];
+		return end - tpl + 1;
+	}
+
+	return -1;
+}
+
+/*
+ * does the text need rendering?
+ *
+ */
+uint8_t template_has_fields(char *tpl) {
+	const struct field_t *field;
+	char arg[TEMPLATE_FIELD_LEN];
+
+	while ((tpl = strchr(tpl, '{'))) {
+		if (tpl[1] == '{') {
+			tpl += 2;
+			continue;
+		}
+		if (parse_field(tpl, &field, arg) > 0) return 1;
+		tpl++;
+	}
+
+	return 0;
+}
+
+/*
+ * make sure every field in a template is known
+ *
+ * The offsets of the time zones used and the dates of countdowns are
+ * looked up here already.
+ */
+int8_t template_check(char *tpl) {
+	const struct field_t *field;
+	char arg[TEMPLATE_FIELD_LEN];
+	int16_t len;
+
+	while ((tpl = strchr(tpl, '{'))) {
+		if (tpl[1] == '{') {
+			tpl += 2;
+			continue;
+		}
+		len = parse_field(tpl, &field, arg);
+		if (len < 0) return -1;
+		if (field->render == render_local) get_zone(arg, time(NULL));
+		if (field->render == render_countdown) get_date(arg);
+		tpl += len;
+	}
+
+	return 1;
+}
+
+/*
+ * fill in the fields of a template
+ *
+ * Returns the time the rendered text changes next. prio is set to the
+ * highest bus priority of the fields used.
+ */
+time_t template_render(char *tpl, time_t now, char *out,
+	uint16_t out_size, uint8_t *prio) {
+	const struct field_t *field;
+	char arg[TEMPLATE_FIELD_LEN];
+	char value[TEMPLATE_FIELD_LEN];
+	time_t next = 0;
+	time_t field_next;
+	uint16_t out_len = 0;
+	uint16_t value_len;
+	int16_t len;
+
+	*prio = PRIO_LOW;
+
+	while (*tpl && out_len < out_size - 1) {
+		if (tpl[0] == '{' && tpl[1] == '{') {
+			out[out_len++] = '{';
+			tpl += 2;
+			continue;
+		}
+
+		len = tpl[0] == '{' ? parse_field(tpl, &field, arg) : -1;
+		if (len < 0) {
+			out[out_len++] = *tpl++;
+			continue;
+		}
+
+		field_next = field->render(arg, now, value);
+		if (!next || field_next < next) next = field_next;
+		if (field->prio > *prio) *prio = field->prio;
+
+		value_len = strlen(value);
+		if (value_len > out_size - 1 - out_len)
+			value_len = out_size - 1 - out_len;
+		memcpy(out + out_len, value, value_len);
+		out_len += value_len;
+		tpl += len;
+	}
+
+	out[out_len] = 0;
+
+	return next;
+}
@@ -0,0 +1,42 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* how often {file:...} fields are read again */
+#ifndef TEMPLATE_FILE_POLL
+#define TEMPLATE_FILE_POLL	1
+#endif
+
+/* longest text a field renders to */
+#define TEMPLATE_FIELD_LEN	64
+
+/* time zones, files and countdowns whose state is kept between renders */
+#ifndef TEMPLATE_ZONES
+#define TEMPLATE_ZONES		8
+#endif
+#ifndef TEMPLATE_FILES
+#define TEMPLATE_FILES		8
+#endif
+#ifndef TEMPLATE_DATES
+#define TEMPLATE_DATES		4
+#endif
+
+extern uint8_t template_has_fields(char *tpl);
+extern int8_t template_check(char *tpl);
+extern time_t template_render(char *tpl, time_t now, char *out,
+	uint16_t out_size, uint8_t *prio);
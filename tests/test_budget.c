@@ -0,0 +1,80 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * bus budget checks
+ *
+ * No second of bus time may carry more than the budget, wherever the
+ * second starts, and only urgent frames may use the headroom.
+ */
+
+#include "../common.h"
+#include "../budget.h"
+
+static uint8_t failed;
+
+static void check(const char *name, int64_t got, int64_t expect) {
+	if (got == expect) return;
+
+	fprintf(stderr, "%s: got %lld, expected %lld\n",
+		name, (long long)got, (long long)expect);
+	failed = 1;
+}
+
+int main() {
+	struct bus_budget_t budget;
+
+	/* 960 bytes per second, 720 after 25% headroom, 540 for low */
+	budget_init(&budget, BUS_BAUD, 25, 0);
+	check("high within limit",
+		budget_admit(&budget, 720, PRIO_HIGH, 0), BUDGET_ADMIT);
+	check("high past limit",
+		budget_admit(&budget, 1, PRIO_HIGH, 0), BUDGET_DEFER);
+	check("urgent uses headroom",
+		budget_admit(&budget, 6, PRIO_URGENT, 0), BUDGET_ADMIT);
+	check("high too large",
+		budget_admit(&budget, 721, PRIO_HIGH, 0), BUDGET_REJECT);
+	check("low too large",
+		budget_admit(&budget, 541, PRIO_LOW, 0), BUDGET_REJECT);
+
+	/* a burst late in a second, then one right after the boundary */
+	budget_init(&budget, BUS_BAUD, 25, 0);
+	check("burst before boundary",
+		budget_admit(&budget, 700, PRIO_HIGH, 950), BUDGET_ADMIT);
+	check("burst after boundary",
+		budget_admit(&budget, 700, PRIO_HIGH, 1050), BUDGET_DEFER);
+	check("wait for the burst to slide out",
+		budget_wait(&budget, 1050), 950);
+	check("still within a second",
+		budget_admit(&budget, 700, PRIO_HIGH, 1949), BUDGET_DEFER);
+	check("a second later",
+		budget_admit(&budget, 700, PRIO_HIGH, 2050), BUDGET_ADMIT);
+
+	/* idle for a long time */
+	check("after idling",
+		budget_admit(&budget, 10, PRIO_HIGH, 60000), BUDGET_ADMIT);
+	check("nothing to wait for",
+		budget_wait(&budget, 62000), 0);
+
+	if (failed) return 1;
+
+	printf("budget: ok\n");
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * UTF-8 transcoding checks
+ *
+ * Every malformed input has to come out as the fallback glyph instead
+ * of some other character.
+ */
+
+#include "../common.h"
+#include "../charset.h"
+
+static uint8_t failed;
+
+static void check(const char *name, char *in, char *expect) {
+	char out[64];
+
+	utf8_to_glyphs(out, sizeof(out), in);
+	if (strcmp(out, expect) == 0) return;
+
+	fprintf(stderr, "%s: got \"%s\", expected \"%s\"\n",
+		name, out, expect);
+	failed = 1;
+}
+
+/* text that does not fit is reported instead of cut short */
+static void check_len(const char *name, uint16_t out_size, char *in,
+	int16_t expect) {
+	char out[64];
+	int16_t got = utf8_to_glyphs(out, out_size, in);
+
+	if (got == expect) return;
+
+	fprintf(stderr, "%s: got %d, expected %d\n", name, got, expect);
+	failed = 1;
+}
+
+int main() {
+	check("ascii", "Route 42", "Route 42");
+	check("latin1", "Caf\xc3\xa9", "Cafe");
+	check("euro", "\xe2\x82\xac" "5", "E5");
+	check("4 byte", "\xf0\x9f\x98\x80!", "?!");
+
+	/* lead bytes that never start a sequence */
+	check("lead f5", "a\xf5\x80\x80\x80" "b", "a????b");
+	check("lead f8", "a\xf8\x88\x80\x80\x80" "b", "a?????b");
+	check("lead ff", "a\xff" "b", "a?b");
+	check("lone continuation", "a\x80" "b", "a?b");
+
+	/* overlong forms */
+	check("overlong c0", "\xc0\xaf", "?");
+	check("overlong c1", "\xc1\xbf", "?");
+	check("overlong 3 byte", "\xe0\x80\xaf", "?");
+	check("overlong 4 byte", "\xf0\x80\x80\xaf", "?");
+
+	/* UTF-16 surrogates */
+	check("surrogate d800", "x\xed\xa0\x80" "y", "x?y");
+	check("surrogate dfff", "x\xed\xbf\xbf" "y", "x?y");
+
+	/* past U+10FFFF */
+	check("above max", "\xf4\x90\x80\x80", "?");
+
+	check("truncated", "a\xe2\x82" "b", "a?b");
+
+	check_len("fits", 5, "abcd", 4);
+	check_len("one too many", 5, "abcde", -1);
+	check_len("multibyte fits", 3, "\xc3\xa9\xc3\xa9", 2);
+
+	if (failed) return 1;
+
+	printf("charset: ok\n");
+
+	return 0;
+}
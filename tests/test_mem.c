@@ -0,0 +1,78 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * mem: ring checks
+ *
+ * Writes keep going when nobody reads the ring back, only the oldest
+ * bytes are lost and the newest frame reads back in one piece.
+ */
+
+#include "../common.h"
+#include "../packet.h"
+#include "../serial.h"
+
+#define FRAME_LEN	200
+
+static uint8_t failed;
+
+static void check(const char *name, int64_t got, int64_t expect) {
+	if (got == expect) return;
+
+	fprintf(stderr, "%s: got %lld, expected %lld\n",
+		name, (long long)got, (long long)expect);
+	failed = 1;
+}
+
+int main() {
+	struct serialport_t port;
+	char buf[FRAME_LEN];
+	uint16_t i, run = 0;
+	char last = 0;
+	int avail;
+
+	check("open", serial_open_port(&port, "mem:", buf, sizeof(buf)), 1);
+
+	/* a few times what the ring holds, nothing reading it back */
+	for (i = 0; i < 2000; i++) {
+		memset(buf, i & 0xff, sizeof(buf));
+		port.buf_len = sizeof(buf);
+		if (serial_write(&port) < 0) break;
+	}
+	check("frames written", i, 2000);
+
+	/* read back what is left, the newest frame has to end it */
+	while (ioctl(port.fd, FIONREAD, &avail) == 0 && avail > 0 &&
+		serial_receive(&port) > 0) {
+		for (i = 0; i < port.buf_len; i++) {
+			run = port.buf[i] == last ? run + 1 : 1;
+			last = port.buf[i];
+		}
+	}
+	check("last frame", (uint8_t)last, 1999 & 0xff);
+	check("last frame whole", run, FRAME_LEN);
+
+	serial_close_port(&port);
+
+	if (failed) return 1;
+
+	printf("mem: ok\n");
+
+	return 0;
+}
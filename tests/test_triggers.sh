@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# Signs on one port with different controller settings each need the
+# trigger of their own controller, or they never show their text.
+#
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cat > "$dir/signs.conf" <<CONF
+port bus file:$dir/bus.bin
+ctlr old 195,255,245
+ctlr new 200,255,245
+sign bus 1 ctlr=old Route 42
+sign bus 2 ctlr=new Downtown
+sign bus 3 ctlr=old Main St
+CONF
+
+./nxtpctl -C "$dir/signs.conf" -S 1s > /dev/null 2>&1 || exit 1
+
+# walk the packets, print the MID of each trigger
+triggers=$(od -An -v -tu1 "$dir/bus.bin" | tr -s ' ' '\n' | awk '
+	NF { b[n++] = $1 }
+	END {
+		for (i = 0; i + 4 < n; i += b[i + 3] + 5)
+			if (b[i + 4] == 84) print b[i]
+	}' | sort -u | tr '\n' ' ')
+
+if [ "$triggers" != "195 200 " ]; then
+	echo "triggers: got MIDs $triggers, expected 195 200" >&2
+	exit 1
+fi
+
+echo "triggers: ok"
@@ -19,59 +19,93 @@
 
 #include "common.h"
 #include "packet.h"
+#include "charset.h"
 #include "text.h"
+#include "trace.h"
 
 /* get the number of segments needed to transmit a message */
-static uint8_t get_num_segs(uint8_t len) {
+static uint16_t get_num_segs(uint16_t len, uint8_t seg_len) {
 	uint8_t k = 0;
-	uint8_t segments = 0;
+	uint16_t segments = 0;
+	uint16_t rec[2];
 
-	for (uint8_t i = 0; i < len; i++) {
-		if (++k == MAX_TEXT_SEG_LEN) {
+	for (uint16_t i = 0; i < len; i++) {
+		if (++k == seg_len) {
 			segments++;
 			k = 0;
 		}
 	}
 
 	/*
-	 * add an extra segment if length is not a multiple of 12
+	 * add an extra segment if length is not a multiple of the
+	 * segment length
 	 *
-	 * needed to accomodate the last segment with < 12 chars
+	 * needed to accomodate the last, shorter segment
 	 */
-	if (len % MAX_TEXT_SEG_LEN) segments++;
+	if (len % seg_len) segments++;
 
-#ifdef DEBUG
-	printf("(%s): length: %u, segments needed: %u,"
-		" last segment will have %u characters\n",
-		__func__, len, segments,
-		MAX_TEXT_SEG_LEN - (segments * MAX_TEXT_SEG_LEN - len));
-#endif
+	rec[0] = len;
+	rec[1] = segments;
+	trace(TRACE_SEGS, rec, sizeof(rec));
 
 	return segments;
 }
 
-static uint16_t make_text_pkts(char *buf, struct ctlr_cfg_t ctlr,
-	uint8_t address, char *text) {
-	char segment[MAX_TEXT_SEG_LEN + 1];
-	uint8_t num_segs = get_num_segs(strlen(text));
+/* is a segment nothing but spaces? */
+static uint8_t seg_is_blank(char *seg, uint8_t seg_len) {
+	for (uint8_t i = 0; i < seg_len; i++) {
+		if (seg[i] != ' ') return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * sparse: the sign was just reset, so blank segments are left out and
+ * the position of each packet puts the others in place
+ */
+static int16_t make_text_pkts(char *buf, uint16_t buf_size,
+	struct ctlr_cfg_t ctlr, struct sign_caps_t caps, uint8_t address,
+	struct text_pos_t pos, char *text, uint16_t text_len, uint8_t sparse) {
+	char segment[MAX_CAPS_SEG_LEN + 1];
+	uint16_t num_segs;
 	uint16_t buf_len = 0;
+	uint8_t seg_len;
 	uint8_t pkt_len;
 
+	if (check_sign_caps(caps) < 0) return -1;
+
+	/* more text than the sign takes */
+	num_segs = get_num_segs(text_len, caps.seg_len);
+	if (num_segs > caps.max_segs) return -1;
+
+	/* the last segment must still have a position of its own */
+	if (!pos.line || !pos.h || !pos.v || pos.v > TEXT_POS_MAX ||
+		pos.h + num_segs - 1 > TEXT_POS_MAX) return -1;
+
 	/* create as many M packets as needed for the entire string */
 	for (uint8_t i = 0; i < num_segs; i++) {
-		memset(segment, 0, MAX_TEXT_SEG_LEN + 1);
-		strncpy(segment, text + MAX_TEXT_SEG_LEN * i,
-			MAX_TEXT_SEG_LEN);
+		seg_len = text_len - caps.seg_len * i > caps.seg_len ?
+			caps.seg_len : text_len - caps.seg_len * i;
+
+		/* make sure the M packet still fits */
+		if (buf_len + MSG_M_SIZE + seg_len + 1 > buf_size) return -1;
+
+		/* an all blank text still needs one packet */
+		if (sparse && seg_is_blank(text + caps.seg_len * i,
+			seg_len) && (buf_len || i < num_segs - 1)) continue;
+
+		memcpy(segment, text + caps.seg_len * i, seg_len);
+		segment[seg_len] = 0;
 		pkt_len = make_m_pkt(buf + buf_len,
 					ctlr,
 					address,
-					1,
-					(((1 + i) & 15) << 4) | 1,
+					pos.line,
+					((pos.h + i) << 4) | pos.v,
 					segment);
+		if (!pkt_len) return -1;
 
-#ifdef DEBUG
-		print_bytes(buf + buf_len, pkt_len);
-#endif
+		trace(TRACE_PKT, buf + buf_len, pkt_len);
 		buf_len += pkt_len;
 
 	}
@@ -79,31 +113,185 @@ static uint16_t make_text_pkts(char *buf, struct ctlr_cfg_t ctlr,
 	return buf_len;
 }
 
+void set_text_pos(struct text_pos_t *pos,
+	uint8_t line, uint8_t h, uint8_t v) {
+	pos->line	= line;
+	pos->h		= h;
+	pos->v		= v;
+}
+
 /*
  * display text (sign will scroll text if longer than 16 chars)
  *
  */
-void make_text(struct ctlr_cfg_t ctlr, struct data_buf_t *buf,
+int8_t make_text(struct ctlr_cfg_t ctlr, struct data_buf_t *buf,
 	uint8_t address, char *text) {
+	struct sign_caps_t caps;
+	struct text_pos_t pos;
+
+	/* the whole sign, as any sign takes it */
+	sign_caps_init(&caps);
+	set_text_pos(&pos, 1, 1, 1);
+
+	return make_text_at(ctlr, caps, buf, address, pos, text);
+}
+
+/*
+ * display text on one line or region of a sign, leaving the rest of
+ * it alone
+ *
+ * UTF-8 text is converted to sign glyphs first so segments are
+ * counted in glyphs rather than bytes
+ */
+int8_t make_text_at(struct ctlr_cfg_t ctlr, struct sign_caps_t caps,
+	struct data_buf_t *buf, uint8_t address, struct text_pos_t pos,
+	char *text) {
+	char glyphs[MAX_CAPS_TEXT_LEN + 1];
+	int16_t num_glyphs;
+	int16_t len = -1;
+
+	num_glyphs = utf8_to_glyphs(glyphs, sizeof(glyphs), text);
 
 	/* create one or more M packets */
-	buf->len = make_text_pkts(buf->data, ctlr, address, text);
+	if (num_glyphs >= 0)
+		len = make_text_pkts(buf->data, buf->size, ctlr, caps,
+			address, pos, glyphs, num_glyphs, 0);
+	if (len < 0) {
+		buf->len = 0;
+		return -1;
+	}
+
+	buf->len = len;
+
+	return 1;
+}
+
+/*
+ * display text on a sign that was just reset
+ *
+ * The sign is blank, so segments of nothing but spaces, like the
+ * padding of centered text, are not sent at all.
+ */
+int8_t make_text_sparse(struct ctlr_cfg_t ctlr, struct sign_caps_t caps,
+	struct data_buf_t *buf, uint8_t address, struct text_pos_t pos,
+	char *text) {
+	char glyphs[MAX_CAPS_TEXT_LEN + 1];
+	int16_t num_glyphs;
+	int16_t len = -1;
+
+	num_glyphs = utf8_to_glyphs(glyphs, sizeof(glyphs), text);
+
+	if (num_glyphs >= 0)
+		len = make_text_pkts(buf->data, buf->size, ctlr, caps,
+			address, pos, glyphs, num_glyphs, 1);
+	if (len < 0) {
+		buf->len = 0;
+		return -1;
+	}
+
+	buf->len = len;
+
+	return 1;
+}
+
+/*
+ * encode text into a frame that can be patched later
+ *
+ */
+int8_t make_text_frame(struct text_frame_t *frame, struct ctlr_cfg_t ctlr,
+	struct sign_caps_t caps, uint8_t address, struct text_pos_t pos,
+	char *text) {
+	int16_t num_glyphs;
+	int16_t len = -1;
+
+	frame->caps = caps;
+
+	num_glyphs = utf8_to_glyphs(frame->glyphs, sizeof(frame->glyphs),
+		text);
+	frame->num_glyphs = num_glyphs < 0 ? 0 : num_glyphs;
+
+	if (num_glyphs >= 0)
+		len = make_text_pkts(frame->data, sizeof(frame->data), ctlr,
+			caps, address, pos, frame->glyphs, num_glyphs, 0);
+	if (len < 0) {
+		frame->len = 0;
+		return -1;
+	}
+
+	frame->len = len;
+
+	return 1;
+}
+
+/*
+ * bring an encoded frame up to date with new text of the same length
+ *
+ * Every segment but the last one fills a whole packet of the size the
+ * sign takes, so glyph i sits at a fixed offset. Returns the number of
+ * glyphs patched, or -1 if the length changed and the frame has to be
+ * encoded again.
+ */
+int16_t patch_text_frame(struct text_frame_t *frame, char *text) {
+	char glyphs[MAX_CAPS_TEXT_LEN + 1];
+	int16_t num_glyphs;
+	uint8_t seg_len = frame->caps.seg_len;
+	uint8_t stride = CAPS_PKT_LEN(frame->caps);
+	uint16_t seg;
+	uint16_t pkt_len;
+	char *pkt;
+	int16_t patched = 0;
+
+	if (!frame->len) return -1;
+
+	num_glyphs = utf8_to_glyphs(glyphs, sizeof(glyphs), text);
+	if (num_glyphs < 0 || num_glyphs != frame->num_glyphs) return -1;
+
+	for (uint16_t i = 0; i < num_glyphs; i++) {
+		if (glyphs[i] == frame->glyphs[i]) continue;
+
+		seg = i / seg_len;
+		pkt = frame->data + seg * stride;
+		pkt_len = frame->len - seg * stride;
+		if (pkt_len > stride) pkt_len = stride;
+
+		patch_pkt_byte(pkt, pkt_len, MSG_M_SIZE + i % seg_len,
+			glyphs[i]);
+		frame->glyphs[i] = glyphs[i];
+		patched++;
+	}
+
+	return patched;
+}
+
+/* put the packets of an encoded frame into a buffer */
+int8_t copy_text_frame(struct text_frame_t *frame, struct data_buf_t *buf) {
+	if (frame->len > buf->size) {
+		buf->len = 0;
+		return -1;
+	}
+
+	memcpy(buf->data, frame->data, frame->len);
+	buf->len = frame->len;
+
+	return 1;
 }
 
 /*
  * text formatting
  *
  */
-void make_format_packet(struct ctlr_cfg_t ctlr, struct data_buf_t *buf,
+int8_t make_format_packet(struct ctlr_cfg_t ctlr, struct data_buf_t *buf,
 	struct text_fmt_t fmt) {
 
+	if (buf->size < MSG_F_SIZE + 1) return -1;
+
 	/* create the F packet */
 	buf->len = make_f_pkt(buf->data, ctlr,
 				fmt.name, fmt.value);
 
-#ifdef DEBUG
-	print_bytes(buf->data, buf->len);
-#endif
+	trace(TRACE_PKT, buf->data, buf->len);
+
+	return 1;
 }
 
 /*
@@ -111,8 +299,11 @@ void make_format_packet(struct ctlr_cfg_t ctlr, struct data_buf_t *buf,
  * useful for preempting important messages like next stop
  *
  */
-void make_reset_packet(struct ctlr_cfg_t ctlr, struct data_buf_t *buf,
-	uint8_t address) {
+int8_t make_reset_packet(struct ctlr_cfg_t ctlr, struct sign_caps_t caps,
+	struct data_buf_t *buf, uint8_t address) {
+
+	if (check_sign_caps(caps) < 0 || buf->size < CAPS_PKT_LEN(caps))
+		return -1;
 
 	/* make a single M packet to reset the sign */
 	buf->len = make_m_pkt(buf->data,
@@ -122,19 +313,22 @@ void make_reset_packet(struct ctlr_cfg_t ctlr, struct data_buf_t *buf,
 				0, /* position = 0: reset the sign */
 				" ");
 
-#ifdef DEBUG
-	print_bytes(buf->data, buf->len);
-#endif
+	trace(TRACE_PKT, buf->data, buf->len);
+
+	return 1;
 }
 
 /*
  * trigger packet
  *
  */
-void make_trigger_packet(struct ctlr_cfg_t ctlr, struct data_buf_t *buf) {
+int8_t make_trigger_packet(struct ctlr_cfg_t ctlr, struct data_buf_t *buf) {
+
+	if (buf->size < MSG_T_SIZE + 1) return -1;
+
 	buf->len = make_t_pkt(buf->data, ctlr);
 
-#ifdef DEBUG
-	print_bytes(buf->data, buf->len);
-#endif
+	trace(TRACE_PKT, buf->data, buf->len);
+
+	return 1;
 }
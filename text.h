@@ -17,15 +17,64 @@
  *
  */
 
+#ifndef MAX_FORMAT_OPTS
+#define MAX_FORMAT_OPTS	10
+#endif
+
 typedef struct text_fmt_t {
 	uint8_t name;
 	uint8_t value;
 } text_fmt_t;
 
-extern void make_text(struct ctlr_cfg_t ctlr, struct data_buf_t *buf,
-	uint8_t address, char *text);
-extern void make_format_packet(struct ctlr_cfg_t ctlr, struct data_buf_t *buf,
-	struct text_fmt_t fmt);
-extern void make_reset_packet(struct ctlr_cfg_t ctlr, struct data_buf_t *buf,
-	uint8_t address);
-extern void make_trigger_packet(struct ctlr_cfg_t ctlr, struct data_buf_t *buf);
+/*
+ * where text goes on a sign
+ *
+ * The horizontal position counts text segments and both positions share
+ * the position byte of an M packet, so each is 1 to 15. Position 0 is
+ * what resets a sign.
+ */
+typedef struct text_pos_t {
+	uint8_t line;	/* message line, 1 on single line signs */
+	uint8_t h;	/* first segment */
+	uint8_t v;	/* row */
+} text_pos_t;
+
+#define TEXT_POS_MAX	15
+
+/*
+ * text encoded once and patched glyph by glyph afterwards
+ *
+ * Text that keeps its length, like a clock, only needs the changed
+ * bytes and the checksums of their packets updated.
+ */
+typedef struct text_frame_t {
+	char glyphs[MAX_CAPS_TEXT_LEN + 1];
+	uint16_t num_glyphs;
+	struct sign_caps_t caps;	/* of the sign it was encoded for */
+	/* as much text as any caps allow, in up to MAX_TEXT_SEGS packets */
+	char data[MAX_TEXT_SEGS * MAX_CAPS_PKT_LEN];
+	uint16_t len;	/* 0 if nothing is encoded */
+} text_frame_t;
+
+extern void set_text_pos(struct text_pos_t *pos,
+	uint8_t line, uint8_t h, uint8_t v);
+extern int8_t make_text(struct ctlr_cfg_t ctlr,
+	struct data_buf_t *buf, uint8_t address, char *text);
+extern int8_t make_text_at(struct ctlr_cfg_t ctlr,
+	struct sign_caps_t caps, struct data_buf_t *buf, uint8_t address,
+	struct text_pos_t pos, char *text);
+extern int8_t make_text_sparse(struct ctlr_cfg_t ctlr,
+	struct sign_caps_t caps, struct data_buf_t *buf, uint8_t address,
+	struct text_pos_t pos, char *text);
+extern int8_t make_text_frame(struct text_frame_t *frame,
+	struct ctlr_cfg_t ctlr, struct sign_caps_t caps, uint8_t address,
+	struct text_pos_t pos, char *text);
+extern int16_t patch_text_frame(struct text_frame_t *frame, char *text);
+extern int8_t copy_text_frame(struct text_frame_t *frame,
+	struct data_buf_t *buf);
+extern int8_t make_format_packet(struct ctlr_cfg_t ctlr,
+	struct data_buf_t *buf, struct text_fmt_t fmt);
+extern int8_t make_reset_packet(struct ctlr_cfg_t ctlr,
+	struct sign_caps_t caps, struct data_buf_t *buf, uint8_t address);
+extern int8_t make_trigger_packet(struct ctlr_cfg_t ctlr,
+	struct data_buf_t *buf);
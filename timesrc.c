@@ -0,0 +1,128 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * time sources
+ *
+ * Everything in the controller that needs the time asks here, so a
+ * whole day of clock or countdown updates can be run through in
+ * simulated time as fast as the encoder goes.
+ */
+
+#include "common.h"
+#include "timesrc.h"
+
+/* microseconds from the monotonic clock */
+static uint64_t system_us() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * current wall clock second
+ *
+ * time() may be served from a coarse clock that lags a few ms behind,
+ * which is not good enough right at the second boundary
+ */
+static time_t system_wall() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return ts.tv_sec;
+}
+
+static void system_sleep(uint32_t ms) {
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	nanosleep(&ts, NULL);
+}
+
+const struct time_source_t timesrc_system = {
+	"system", system_us, system_wall, system_sleep
+};
+
+/* simulated time, only moves when slept on or advanced */
+static time_t sim_start;
+static uint64_t sim_us;
+
+static uint64_t simulated_us() {
+	return sim_us;
+}
+
+static time_t simulated_wall() {
+	return sim_start + sim_us / 1000000;
+}
+
+static void simulated_sleep(uint32_t ms) {
+	sim_us += (uint64_t)ms * 1000;
+}
+
+const struct time_source_t timesrc_simulated = {
+	"simulated", simulated_us, simulated_wall, simulated_sleep
+};
+
+static const struct time_source_t *source = &timesrc_system;
+
+void timesrc_use(const struct time_source_t *src) {
+	source = src;
+}
+
+/* switch to simulated time, starting at the given wall clock second */
+void timesrc_simulate(time_t start) {
+	sim_start = start;
+	sim_us = 0;
+	source = &timesrc_simulated;
+}
+
+/*
+ * jump to the start of a wall clock second
+ *
+ * Time never goes backwards and the system clock can't be moved, so
+ * this does nothing unless simulating.
+ */
+void timesrc_advance_to(time_t wall) {
+	uint64_t us;
+
+	if (source != &timesrc_simulated || wall <= sim_start) return;
+
+	us = (uint64_t)(wall - sim_start) * 1000000;
+	if (us > sim_us) sim_us = us;
+}
+
+uint64_t timesrc_us() {
+	return source->us();
+}
+
+uint64_t timesrc_ms() {
+	return source->us() / 1000;
+}
+
+time_t timesrc_wall() {
+	return source->wall();
+}
+
+void timesrc_sleep_ms(uint32_t ms) {
+	source->sleep(ms);
+}
@@ -0,0 +1,47 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+typedef uint64_t (*timesrc_us_t)(void);
+typedef time_t (*timesrc_wall_t)(void);
+typedef void (*timesrc_sleep_t)(uint32_t ms);
+
+/*
+ * where the controller takes its time from
+ *
+ * The monotonic clock paces the bus budget, the wall clock drives the
+ * template fields. A simulated source keeps both in step and jumps
+ * ahead instead of sleeping.
+ */
+typedef struct time_source_t {
+	char *name;
+	timesrc_us_t us;	/* monotonic microseconds */
+	timesrc_wall_t wall;	/* wall clock second */
+	timesrc_sleep_t sleep;
+} time_source_t;
+
+extern const struct time_source_t timesrc_system;
+extern const struct time_source_t timesrc_simulated;
+
+extern void timesrc_use(const struct time_source_t *src);
+extern void timesrc_simulate(time_t start);
+extern void timesrc_advance_to(time_t wall);
+extern uint64_t timesrc_us(void);
+extern uint64_t timesrc_ms(void);
+extern time_t timesrc_wall(void);
+extern void timesrc_sleep_ms(uint32_t ms);
@@ -0,0 +1,266 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * binary trace of the hot path
+ *
+ * Formatting every packet through stdio while sending it blocks on the
+ * terminal and throws the bus timing off. Instead, fixed size records
+ * go into a lock-free ring per thread. A background thread drains the
+ * rings into a file, and the file is turned into text later with
+ * trace_decode().
+ *
+ * The drain thread is started before any real-time profile is set up,
+ * so it keeps the normal policy and CPU set.
+ */
+
+#include "common.h"
+#include "trace.h"
+
+#define TRACE_MAGIC	"NXTPTRC1"
+
+_Atomic uint8_t trace_enabled;
+
+static struct trace_ring_t rings[TRACE_MAX_THREADS];
+static _Atomic uint8_t num_rings;
+static _Thread_local struct trace_ring_t *my_ring;
+static _Thread_local uint8_t no_ring;
+
+/* drain thread */
+static pthread_t drain_thread;
+static _Atomic uint8_t draining;
+static FILE *trace_file;
+
+/* the ring of the calling thread, handed out on its first record */
+static struct trace_ring_t *get_ring() {
+	uint8_t idx;
+
+	if (my_ring || no_ring) return my_ring;
+
+	idx = atomic_fetch_add(&num_rings, 1);
+	if (idx >= TRACE_MAX_THREADS) {
+		no_ring = 1;
+		return NULL;
+	}
+
+	my_ring = &rings[idx];
+
+	return my_ring;
+}
+
+/*
+ * add a record, never blocks
+ *
+ * When the drain can't keep up the record is dropped and counted.
+ */
+void trace_put(uint8_t type, const void *data, uint16_t len) {
+	struct trace_ring_t *ring = get_ring();
+	struct trace_rec_t *rec;
+	struct timespec ts;
+	uint32_t head;
+
+	if (!ring) return;
+
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) ==
+		TRACE_RECORDS) {
+		atomic_fetch_add_explicit(&ring->dropped, 1,
+			memory_order_relaxed);
+		return;
+	}
+
+	rec = &ring->rec[head & (TRACE_RECORDS - 1)];
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec->us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	rec->type = type;
+	rec->total = len;
+	rec->len = len < TRACE_DATA_LEN ? len : TRACE_DATA_LEN;
+	memcpy(rec->data, data, rec->len);
+
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/*
+ * hand every record written so far to out
+ *
+ * Only one thread may drain at a time.
+ */
+uint32_t trace_drain(trace_out_t out, void *arg) {
+	uint8_t used = atomic_load(&num_rings);
+	struct trace_ring_t *ring;
+	uint32_t drained = 0;
+	uint32_t head;
+	uint32_t tail;
+
+	if (used > TRACE_MAX_THREADS) used = TRACE_MAX_THREADS;
+
+	for (uint8_t i = 0; i < used; i++) {
+		ring = &rings[i];
+		tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+		for (; tail != head; tail++) {
+			out(arg, &ring->rec[tail & (TRACE_RECORDS - 1)]);
+			drained++;
+		}
+
+		atomic_store_explicit(&ring->tail, tail, memory_order_release);
+	}
+
+	return drained;
+}
+
+static const char *type_name(uint8_t type) {
+	switch (type) {
+		case TRACE_PKT:		return "PKT";
+		case TRACE_SEGS:	return "SEGS";
+		case TRACE_TX:		return "TX";
+		case TRACE_RX:		return "RX";
+		case TRACE_DLE:		return "DLE";
+		default:		return "?";
+	}
+}
+
+/* one line per record, printable bytes as characters */
+void trace_format(struct trace_rec_t *rec, FILE *f) {
+	fprintf(f, "%llu.%06llu %s %u:",
+		(unsigned long long)(rec->us / 1000000),
+		(unsigned long long)(rec->us % 1000000),
+		type_name(rec->type), rec->total);
+
+	for (uint8_t i = 0; i < rec->len; i++) {
+		if (rec->data[i] >= 0x20 && rec->data[i] <= 0x7e) {
+			fprintf(f, " '%c'", rec->data[i]);
+		} else {
+			fprintf(f, " %02x", rec->data[i]);
+		}
+	}
+
+	fprintf(f, "%s\n", rec->len < rec->total ? " ..." : "");
+}
+
+static void write_rec(void *arg, struct trace_rec_t *rec) {
+	fwrite(rec, sizeof(struct trace_rec_t), 1, (FILE *)arg);
+}
+
+static void *drain_worker(void *arg) {
+	struct timespec ts;
+
+	(void)arg;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = TRACE_DRAIN_MS * 1000000;
+
+	while (atomic_load(&draining)) {
+		if (trace_drain(write_rec, trace_file)) fflush(trace_file);
+		nanosleep(&ts, NULL);
+	}
+
+	return NULL;
+}
+
+/*
+ * start tracing into a file
+ *
+ */
+int8_t trace_start(char *path) {
+	uint16_t rec_size = sizeof(struct trace_rec_t);
+
+	trace_file = fopen(path, "wb");
+	if (!trace_file) {
+		log_err("(%s): Couldn't open %s: %d (%s)\n",
+			__func__, path, -errno, strerror(errno));
+		return -1;
+	}
+
+	fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace_file);
+	fwrite(&rec_size, sizeof(rec_size), 1, trace_file);
+
+	atomic_store(&draining, 1);
+	if (pthread_create(&drain_thread, NULL, drain_worker, NULL) != 0) {
+		log_err("(%s): Couldn't start the drain thread\n", __func__);
+		atomic_store(&draining, 0);
+		fclose(trace_file);
+		trace_file = NULL;
+		return -1;
+	}
+
+	atomic_store(&trace_enabled, 1);
+
+	return 1;
+}
+
+/*
+ * stop tracing, write what is left and report dropped records
+ *
+ */
+void trace_stop() {
+	uint32_t dropped = 0;
+
+	if (!trace_file) return;
+
+	atomic_store(&trace_enabled, 0);
+	atomic_store(&draining, 0);
+	pthread_join(drain_thread, NULL);
+
+	trace_drain(write_rec, trace_file);
+	fclose(trace_file);
+	trace_file = NULL;
+
+	for (uint8_t i = 0; i < TRACE_MAX_THREADS; i++)
+		dropped += atomic_load(&rings[i].dropped);
+	if (dropped)
+		log_err("Trace: %u records dropped.\n", dropped);
+}
+
+/*
+ * print a trace file as text
+ *
+ */
+int8_t trace_decode(char *path) {
+	struct trace_rec_t rec;
+	char magic[sizeof(TRACE_MAGIC)] = {0};
+	uint16_t rec_size = 0;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		log_err("(%s): Couldn't open %s: %d (%s)\n",
+			__func__, path, -errno, strerror(errno));
+		return -1;
+	}
+
+	if (fread(magic, 1, strlen(TRACE_MAGIC), f) != strlen(TRACE_MAGIC) ||
+		strcmp(magic, TRACE_MAGIC) != 0 ||
+		fread(&rec_size, sizeof(rec_size), 1, f) != 1 ||
+		rec_size != sizeof(struct trace_rec_t)) {
+		log_err("(%s): %s is not a trace from this build\n",
+			__func__, path);
+		fclose(f);
+		return -1;
+	}
+
+	while (fread(&rec, sizeof(struct trace_rec_t), 1, f) == 1)
+		trace_format(&rec, stdout);
+
+	fclose(f);
+
+	return 1;
+}
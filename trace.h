@@ -0,0 +1,71 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+/* records are 64 bytes, longer data is cut short */
+#define TRACE_DATA_LEN		52
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS		1024	/* per thread, a power of two */
+#endif
+#define TRACE_MAX_THREADS	4
+#define TRACE_DRAIN_MS		20
+
+/* record types */
+#define TRACE_PKT		1	/* packet encoded */
+#define TRACE_SEGS		2	/* text length and segments */
+#define TRACE_TX		3	/* bytes written to a port */
+#define TRACE_RX		4	/* bytes read from a port */
+#define TRACE_DLE		5	/* reply to a request parameter */
+
+typedef struct trace_rec_t {
+	uint64_t us;		/* monotonic */
+	uint8_t type;
+	uint8_t len;		/* bytes in data */
+	uint16_t total;		/* bytes the event had */
+	uint8_t data[TRACE_DATA_LEN];
+} trace_rec_t;
+
+/* written by one thread only, read by the drain */
+typedef struct trace_ring_t {
+	_Atomic uint32_t head;
+	_Atomic uint32_t tail;
+	_Atomic uint32_t dropped;
+	struct trace_rec_t rec[TRACE_RECORDS];
+} trace_ring_t;
+
+typedef void (*trace_out_t)(void *arg, struct trace_rec_t *rec);
+
+extern _Atomic uint8_t trace_enabled;
+
+/* costs a single load while tracing is off */
+#define trace(type, data, len) \
+	do { \
+		if (atomic_load_explicit(&trace_enabled, \
+			memory_order_relaxed)) \
+			trace_put(type, data, len); \
+	} while (0)
+
+extern void trace_put(uint8_t type, const void *data, uint16_t len);
+extern uint32_t trace_drain(trace_out_t out, void *arg);
+extern void trace_format(struct trace_rec_t *rec, FILE *f);
+extern int8_t trace_start(char *path);
+extern void trace_stop(void);
+extern int8_t trace_decode(char *path);
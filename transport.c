@@ -0,0 +1,336 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * transport backends for the serial port layer
+ *
+ *   /dev/ttyUSB0, tty:<dev>	serial device, 9600 8n1 raw
+ *   pty:			new pseudo terminal, the sign side is
+ *				logged and can be opened by a simulator,
+ *				it keeps its name when one comes back
+ *   file:<path>		append everything sent to a file
+ *   mem:			in-memory ring that reads back what was
+ *				sent, for tests and benchmarks, the
+ *				oldest bytes give way when it is full
+ *   tcp:<host>:<port>		serial-over-IP bridge or terminal server
+ *   unix:<path>		local socket
+ *
+ * All of them end up as file descriptors, so they work with the event
+ * loop the same way. Write-only transports have no descriptor to read.
+ *
+ * parts of the tty code came from
+ * https://stackoverflow.com/questions/57152937/canonical-mode-linux-serial-port/57155531#57155531
+ */
+
+#include "common.h"
+#include "packet.h"
+#include "serial.h"
+#include "transport.h"
+
+/* 9600 baud 8n1 raw */
+static int8_t set_raw(int fd) {
+	struct termios tty;
+
+	memset(&tty, 0, sizeof(struct termios));
+
+	if (tcgetattr(fd, &tty) != 0) {
+		log_err("(%s): Error from tcgetattr: %d (%s)\n",
+			__func__, -errno, strerror(errno));
+		return -1;
+	}
+
+	/* set speed to 9600 baud, 8n1 */
+	cfsetospeed(&tty, B9600);
+	cfsetispeed(&tty, B9600);
+
+	tty.c_cflag |= CLOCAL | CREAD;	/* ignore modem controls */
+	tty.c_cflag &= ~CSIZE;
+	tty.c_cflag |= CS8;		/* 8-bit characters */
+	tty.c_cflag &= ~PARENB;		/* no parity bit */
+	tty.c_cflag &= ~CSTOPB;		/* only need 1 stop bit */
+	tty.c_cflag &= ~CRTSCTS;	/* no hardware flow control */
+
+	/* setup for non-canonical mode */
+	tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR);
+	tty.c_iflag &= ~(ICRNL | IXON);
+	tty.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+	tty.c_oflag &= ~OPOST;
+
+	/* fetch bytes as they become available */
+	tty.c_cc[VMIN] = 1;
+	tty.c_cc[VTIME] = 1;
+
+	if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+		log_err("(%s): Error from tcsetattr: %d (%s)\n",
+			__func__, -errno, strerror(errno));
+		return -1;
+	}
+
+	return 1;
+}
+
+/*
+ * look for the /dev/serial/by-id link of a device
+ *
+ * ttyUSB numbers are handed out in plug order, the by-id names stay
+ * the same for the same adapter
+ */
+static void find_stable_path(char *path, char *stable) {
+	char dev[PATH_MAX];
+	char link[PATH_MAX];
+	char target[PATH_MAX];
+	struct dirent *entry;
+	DIR *dir;
+
+	if (!realpath(path, dev)) return;
+
+	/* already a stable name */
+	if (strcmp(dev, path) != 0) return;
+
+	dir = opendir(SERIAL_BY_ID);
+	if (!dir) return;
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.') continue;
+
+		snprintf(link, PATH_MAX, SERIAL_BY_ID "/%s", entry->d_name);
+		if (!realpath(link, target) || strcmp(target, dev) != 0)
+			continue;
+
+		if (strlen(link) < PORT_SIZE) {
+			strcpy(stable, link);
+			log_msg("Following %s as %s.\n", path, stable);
+		}
+		break;
+	}
+
+	closedir(dir);
+}
+
+static int8_t tty_open(struct serialport_t *port_obj, char *path) {
+	/* open sesame */
+	port_obj->fd = open(path, O_RDWR | O_NOCTTY | O_SYNC);
+	if (port_obj->fd < 0) {
+		log_err("(%s): Error opening %s: %d (%s)\n",
+			__func__, path, -errno, strerror(errno));
+		return -1;
+	}
+	port_obj->out_fd = port_obj->fd;
+
+	if (!port_obj->stable[0]) find_stable_path(path, port_obj->stable);
+
+	return set_raw(port_obj->fd);
+}
+
+static void tty_drain(struct serialport_t *port_obj) {
+	tcdrain(port_obj->out_fd);
+}
+
+static int8_t pty_open(struct serialport_t *port_obj, char *path) {
+	char *name;
+	int fd;
+
+	(void)path;
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 ||
+		!(name = ptsname(fd))) {
+		log_err("(%s): Couldn't create a pty: %d (%s)\n",
+			__func__, -errno, strerror(errno));
+		if (fd >= 0) close(fd);
+		return -1;
+	}
+
+	port_obj->fd = port_obj->out_fd = fd;
+	log_msg("Signs can be attached to %s.\n", name);
+
+	return set_raw(fd);
+}
+
+/*
+ * a simulator going away hangs up the pty, which is kept so the next
+ * one finds it under the same name, and is back once one is attached
+ */
+static int8_t pty_reopen(struct serialport_t *port_obj, char *path) {
+	struct pollfd pfd;
+
+	if (port_obj->fd < 0) return pty_open(port_obj, path);
+
+	pfd.fd = port_obj->fd;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) < 0 || (pfd.revents & POLLHUP)) return -1;
+
+	return 1;
+}
+
+static int8_t file_open(struct serialport_t *port_obj, char *path) {
+	port_obj->out_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (port_obj->out_fd < 0) {
+		log_err("(%s): Error opening %s: %d (%s)\n",
+			__func__, path, -errno, strerror(errno));
+		return -1;
+	}
+
+	/* nothing ever comes back */
+	port_obj->fd = -1;
+
+	return 1;
+}
+
+static int8_t mem_open(struct serialport_t *port_obj, char *path) {
+	int fds[2];
+
+	(void)path;
+
+	/* the kernel keeps the ring, mem_write() makes room in it */
+	if (pipe(fds) < 0) {
+		log_err("(%s): Couldn't create ring: %d (%s)\n",
+			__func__, -errno, strerror(errno));
+		return -1;
+	}
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	port_obj->fd = fds[0];
+	port_obj->out_fd = fds[1];
+
+	return 1;
+}
+
+/*
+ * write to the ring, dropping the oldest bytes while it is full
+ *
+ * Nothing has to read the ring back for writes to keep working.
+ */
+static int32_t mem_write(struct serialport_t *port_obj, char *buf,
+	uint16_t len) {
+	char old[256];
+	int32_t ret;
+
+	while ((ret = write(port_obj->out_fd, buf, len)) < 0 &&
+		errno == EAGAIN) {
+		if (read(port_obj->fd, old, sizeof(old)) <= 0) return -1;
+	}
+
+	return ret;
+}
+
+static int8_t sock_connect(struct serialport_t *port_obj, int family,
+	struct sockaddr *addr, socklen_t addr_len) {
+	int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (fd < 0) return -1;
+
+	if (connect(fd, addr, addr_len) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	port_obj->fd = port_obj->out_fd = fd;
+
+	return 1;
+}
+
+static int8_t tcp_open(struct serialport_t *port_obj, char *path) {
+	char host[PORT_SIZE] = {0};
+	struct addrinfo hints;
+	struct addrinfo *res;
+	struct addrinfo *ai;
+	char *service = strrchr(path, ':');
+	int8_t ret = -1;
+	int err;
+
+	if (!service) {
+		log_err("(%s): Missing port in %s\n", __func__, path);
+		return -1;
+	}
+	memcpy(host, path, service - path);
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	err = getaddrinfo(host, service + 1, &hints, &res);
+	if (err) {
+		log_err("(%s): Couldn't resolve %s: %s\n",
+			__func__, path, gai_strerror(err));
+		return -1;
+	}
+
+	for (ai = res; ai && ret < 0; ai = ai->ai_next)
+		ret = sock_connect(port_obj, ai->ai_family,
+			ai->ai_addr, ai->ai_addrlen);
+	freeaddrinfo(res);
+
+	if (ret < 0)
+		log_err("(%s): Couldn't connect to %s: %d (%s)\n",
+			__func__, path, -errno, strerror(errno));
+
+	return ret;
+}
+
+static int8_t unix_open(struct serialport_t *port_obj, char *path) {
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	if (sock_connect(port_obj, AF_UNIX, (struct sockaddr *)&addr,
+		sizeof(struct sockaddr_un)) < 0) {
+		log_err("(%s): Couldn't connect to %s: %d (%s)\n",
+			__func__, path, -errno, strerror(errno));
+		return -1;
+	}
+
+	return 1;
+}
+
+static const struct transport_t transports[] = {
+	{"tty:",	tty_open,	NULL,		NULL,		tty_drain},
+	{"pty:",	pty_open,	pty_reopen,	NULL,		tty_drain},
+	{"file:",	file_open,	NULL,		NULL,		NULL},
+	{"mem:",	mem_open,	NULL,		mem_write,	NULL},
+	{"tcp:",	tcp_open,	NULL,		NULL,		NULL},
+	{"unix:",	unix_open,	NULL,		NULL,		NULL},
+};
+
+#define NUM_TRANSPORTS	(sizeof(transports) / sizeof(transports[0]))
+
+/*
+ * pick the transport for a port name, path is set to what follows the
+ * prefix
+ *
+ */
+const struct transport_t *transport_find(char *port, char **path) {
+	uint8_t len;
+
+	for (uint8_t i = 0; i < NUM_TRANSPORTS; i++) {
+		len = strlen(transports[i].prefix);
+		if (strncmp(port, transports[i].prefix, len) == 0) {
+			*path = port + len;
+			return &transports[i];
+		}
+	}
+
+	/* plain device path */
+	*path = port;
+
+	return &transports[0];
+}
@@ -0,0 +1,47 @@
+/*
+ * Sunrise Systems NXTP Transit Sign Driver
+ * Copyright (C) 2022 Anthony96922
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+struct serialport_t;
+
+/* stable names of USB serial adapters */
+#define SERIAL_BY_ID	"/dev/serial/by-id"
+
+typedef int8_t (*transport_open_t)(struct serialport_t *port_obj,
+	char *path);
+typedef int8_t (*transport_reopen_t)(struct serialport_t *port_obj,
+	char *path);
+typedef int32_t (*transport_write_t)(struct serialport_t *port_obj,
+	char *buf, uint16_t len);
+typedef void (*transport_drain_t)(struct serialport_t *port_obj);
+
+/*
+ * how a port reaches the bus
+ *
+ * Ports are named "<prefix><path>", a name without a known prefix is a
+ * tty device.
+ */
+typedef struct transport_t {
+	char *prefix;
+	transport_open_t open;
+	transport_reopen_t reopen;	/* NULL to close and open again */
+	transport_write_t write;	/* NULL for a plain write() */
+	transport_drain_t drain;	/* NULL if writes need no wait */
+} transport_t;
+
+extern const struct transport_t *transport_find(char *port, char **path);